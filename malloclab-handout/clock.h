@@ -20,3 +20,25 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/* Read the cycle counter inline, cheap enough to time a single malloc
+   call. Other platforms count nanoseconds instead */
+#if defined(__i386__) || defined(__x86_64__)
+static inline unsigned long long read_counter(void)
+{
+    unsigned hi, lo;
+
+    /* lfence keeps rdtsc from running ahead of the code being timed */
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+#else
+#include <time.h>
+static inline unsigned long long read_counter(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# compare.sh - run two mdriver builds on the same traces and print their
+# util and throughput side by side.
+#
+# usage: ./compare.sh <mdriver-a> <mdriver-b> [mdriver args]
+#   e.g. ./compare.sh ./mdriver ./mdriver-tlsf -f traces/boat.rep
+#
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <mdriver-a> <mdriver-b> [mdriver args]" >&2
+    exit 1
+fi
+a=$1
+b=$2
+shift 2
+
+# mdriver -v 1 prints fixed width rows: util in columns 7-12, ops in
+# 14-21, secs in 22-31, then Kops and the trace name. The weighted
+# total row comes last.
+results() {
+    bin=$1
+    shift
+    "$bin" -v 1 "$@" | awk '
+        /^Results for mm malloc/ { on = 1; next }
+        on && / yes | no / {
+            n = split(substr($0, 32), rest, " ")
+            util = substr($0, 7, 6); gsub(/ /, "", util)
+            if ($0 ~ / no /) { util = "-"; rest[1] = "-" }
+            print rest[n], util, rest[1]
+        }
+        on && /^ *[0-9]+ +[0-9]+ +[0-9]+%/ { print "total", $3, $6; on = 0 }'
+}
+
+ra=$(mktemp) || exit 1
+rb=$(mktemp) || exit 1
+trap 'rm -f "$ra" "$rb"' EXIT
+
+results "$a" "$@" > "$ra" || exit 1
+results "$b" "$@" > "$rb" || exit 1
+
+printf "%-36s %7s %7s %8s %8s\n" "trace" "util-a" "util-b" "Kops-a" "Kops-b"
+paste -d ' ' "$ra" "$rb" | awk '{ printf "%-36s %7s %7s %8s %8s\n", $1, $2, $5, $3, $6 }'
+echo "a = $a, b = $b"
@@ -0,0 +1,5 @@
+/*
+ * big.h - links count 8 byte units, so the heap can grow to 32G with
+ * the same 4 byte links and headers
+ */
+#define OFS_SHIFT	3
@@ -0,0 +1,6 @@
+/*
+ * fine.h - two seglists per power of two, and the size tree only above
+ * 16K, for closer fits on the small and medium sizes
+ */
+#define CLASS_SUB_LOG2	1
+#define TREE_LOG2		14
@@ -0,0 +1,5 @@
+/*
+ * firstfit.h - take the first block that fits instead of the smallest
+ * one of the first list with a fit
+ */
+#define FIT_POLICY	FIT_FIRST
@@ -0,0 +1,5 @@
+/*
+ * fixed.h - grow the heap by fixed CHUNKSIZE chunks instead of the
+ * adaptive steps
+ */
+#define GROW_CAP	0
@@ -0,0 +1,5 @@
+/*
+ * footers.h - allocated blocks keep their footer, as in the textbook
+ * allocator. Costs util against the default footer elision
+ */
+#define FOOTERS		1
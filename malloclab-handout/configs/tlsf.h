@@ -0,0 +1,5 @@
+/*
+ * tlsf.h - two-level (TLSF) list index instead of the power of two
+ * seglists and the size tree, good fit in O(1)
+ */
+#define TLSF
@@ -0,0 +1,6 @@
+/*
+ * top.h - grow the heap by 4K chunks, but only by what the free block
+ * at the top is missing
+ */
+#define CHUNKSIZE	(1 << 12)
+#define GROW_POLICY	GROW_TOP
@@ -13,6 +13,7 @@
 
 #include "fcyc.h"
 #include "clock.h"
+#include "perfctr.h"
 
 /* Default values */
 #define K 3                  /* Value of K in K-best scheme */
@@ -36,6 +37,9 @@ static int *cache_buf = NULL;
 static double *values = NULL;
 static int samplecount = 0;
 
+/* event counts of the fastest sample, if perf_init opened any */
+static perf_counts_t best_counts;
+
 /* for debugging only */
 #define KEEP_VALS 0
 #define KEEP_SAMPLES 0
@@ -129,15 +133,26 @@ static void clear()
 double fcyc(test_funct f, void *argp)
 {
     double result;
+    int counting = perf_available();
+    perf_counts_t counts;
+
     init_sampler();
+    perf_clear(&best_counts);
     if (compensate) {
 	do {
 	    double cyc;
 	    if (clear_cache)
 		clear();
+	    if (counting)
+		perf_start();
 	    start_comp_counter();
 	    f(argp);
 	    cyc = get_comp_counter();
+	    if (counting) {
+		perf_stop(&counts);
+		if (samplecount == 0 || cyc < values[0])
+		    best_counts = counts;
+	    }
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     } else {
@@ -145,9 +160,16 @@ double fcyc(test_funct f, void *argp)
 	    double cyc;
 	    if (clear_cache)
 		clear();
+	    if (counting)
+		perf_start();
 	    start_counter();
 	    f(argp);
 	    cyc = get_counter();
+	    if (counting) {
+		perf_stop(&counts);
+		if (samplecount == 0 || cyc < values[0])
+		    best_counts = counts;
+	    }
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     }
@@ -168,6 +190,15 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * fcyc_counts - Event counts of the sample the last fcyc returned, all
+ *     unavailable if perf_init opened no events
+ */
+void fcyc_counts(perf_counts_t *counts)
+{
+    *counts = best_counts;
+}
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
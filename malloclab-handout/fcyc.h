@@ -7,12 +7,17 @@
  *
  */
 
+#include "perfctr.h"
+
 /* The test function takes a generic pointer as input */
 typedef void (*test_funct)(void *);
 
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Hardware event counts of the run fcyc last returned the cycles of */
+void fcyc_counts(perf_counts_t *counts);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -37,6 +37,17 @@ void init_fsecs(void)
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
 #endif
+
+    /* hardware events come with the cycle counter only */
+#if USE_FCYC
+    if (perf_init() > 0) {
+	if (verbose)
+	    printf("Counting %d hardware events per run with perf_event_open.\n",
+		   perf_available());
+    } else if (verbose > 1) {
+	printf("No hardware events, perf_event_open is unavailable.\n");
+    }
+#endif
 }
 
 /*
@@ -54,4 +65,17 @@ double fsecs(fsecs_test_funct f, void *argp)
 #endif 
 }
 
+/*
+ * fsecs_counts - Return the hardware event counts of the run the last
+ *     fsecs timed, unavailable unless the cycle counter timed it
+ */
+void fsecs_counts(perf_counts_t *counts)
+{
+#if USE_FCYC
+    fcyc_counts(counts);
+#else
+    perf_clear(counts);
+#endif
+}
+
 
@@ -0,0 +1,656 @@
+/*
+ * gen.c - generate synthetic traces from a workload spec
+ *
+ * A spec is a text file of directives, one per line, '#' starts a
+ * comment. The trace is a series of phases; each phase runs for a number
+ * of allocations and takes the directives that follow its "phase" line,
+ * inheriting whatever it doesn't set from the phase before it.
+ * Directives before the first phase set the defaults.
+ *
+ *   seed <n>                   seed of the generator (default 1)
+ *   weight <n>                 weight in the trace header (default 1)
+ *   phase <n>                  start a phase of n allocations
+ *   sizes <s>[-<t>]:<w> ...    size histogram: sizes s, or uniform in
+ *                              [s, t], picked with weight w
+ *   lifetime fixed <n>         lifetime in allocations: always n,
+ *   lifetime uniform <n> <m>   uniform in [n, m],
+ *   lifetime exp <mean>        exponential with that mean,
+ *   lifetime hist <n>[-<m>]:<w> ...  or from a histogram like sizes
+ *   pattern random             free when the lifetime runs out,
+ *   pattern fifo <n>           free in allocation order n allocations
+ *                              later (a producer/consumer queue),
+ *   pattern lifo <n>           allocate n blocks, then free them
+ *                              newest first (a stack),
+ *   pattern region <n>         or allocate into a region that ends
+ *                              every n allocations (a request handler):
+ *                              lifetimes are cut at its end, which
+ *                              releases what is still live
+ *   realloc <p> <f> <n>        with probability p a block is grown n
+ *                              times by a factor f over its lifetime,
+ *                              never in a region
+ *   calloc <p>                 with probability p an allocation is a
+ *                              calloc, on the heap even in a region
+ *
+ * Time is counted in allocations. Frees and reallocs that fall due are
+ * issued before the next allocation; when the last phase ends the
+ * remaining ones run in order, so every block is freed or released
+ * with its region. Ids of freed blocks are reused, which keeps num_ids
+ * near the peak live count.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gen.h"
+
+#define MAXLINE		1024
+#define MAXBINS		64
+#define MAXSIZE		0x7fffffff	/* delta records hold 31 bit sizes */
+
+/* one bin of a histogram: values in [lo, hi] picked with weight w */
+typedef struct {
+    long lo, hi;
+    double w;
+} bin_t;
+
+typedef struct {
+    bin_t bin[MAXBINS];
+    int nbins;
+    double total;                   /* sum of the weights */
+} hist_t;
+
+enum { LIFE_FIXED, LIFE_UNIFORM, LIFE_EXP, LIFE_HIST };
+enum { PAT_RANDOM, PAT_FIFO, PAT_LIFO, PAT_REGION };
+
+/* event type that gives a region block's id back at the region's end,
+   without a request */
+#define EV_DROP		(-1)
+
+/* the workload of one phase */
+typedef struct {
+    long allocs;
+    hist_t sizes;
+    int life;
+    long life_a, life_b;            /* fixed n, or uniform [a, b] */
+    double life_mean;
+    hist_t life_hist;
+    int pattern;
+    long batch;                     /* fifo queue depth, lifo stack size,
+                                       allocations per region */
+    double re_prob, re_factor;
+    int re_steps;
+    double calloc_prob;
+} phase_t;
+
+/* a free, realloc or region end that falls due at time, ordered by
+   (time, order, seq) */
+typedef struct {
+    long time;
+    long order;                     /* the seq of the block's first event,
+                                       negated past its last for lifo */
+    long seq;
+    int type;
+    int index;
+    size_t size;
+} event_t;
+
+typedef struct {
+    event_t *ev;
+    long n, cap;
+} heap_t;
+
+/* growable output arrays */
+typedef struct {
+    btrace_op_t *ops;
+    long n, cap;
+    int *free_ids;                  /* stack of ids to reuse */
+    int nfree, free_cap;
+    int next_id;
+} out_t;
+
+static unsigned long long rng_state;
+
+/*
+ * Random numbers - xorshift64*, seeded through splitmix64 so that small
+ * seeds give unrelated streams
+ */
+static void rng_seed(unsigned long long seed)
+{
+    unsigned long long z = seed + 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    rng_state = (z ^ (z >> 31)) | 1;
+}
+
+static unsigned long long rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform in [0, 1) */
+static double rng_unit(void)
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* uniform in [lo, hi] */
+static long rng_range(long lo, long hi)
+{
+    return lo + (long)(rng_next() % (unsigned long long)(hi - lo + 1));
+}
+
+static long hist_pick(const hist_t *h)
+{
+    double x = rng_unit() * h->total;
+    int i;
+
+    for (i = 0; i < h->nbins - 1; i++) {
+        if (x < h->bin[i].w)
+            break;
+        x -= h->bin[i].w;
+    }
+    return rng_range(h->bin[i].lo, h->bin[i].hi);
+}
+
+static long pick_life(const phase_t *ph)
+{
+    long n;
+
+    switch (ph->life) {
+    case LIFE_UNIFORM:
+        n = rng_range(ph->life_a, ph->life_b);
+        break;
+    case LIFE_EXP:
+        n = (long)ceil(-ph->life_mean * log(1.0 - rng_unit()));
+        break;
+    case LIFE_HIST:
+        n = hist_pick(&ph->life_hist);
+        break;
+    default:
+        n = ph->life_a;
+    }
+    return n < 1 ? 1 : n;
+}
+
+/*
+ * Event heap
+ */
+static int ev_before(const event_t *a, const event_t *b)
+{
+    if (a->time != b->time)
+        return a->time < b->time;
+    if (a->order != b->order)
+        return a->order < b->order;
+    return a->seq < b->seq;
+}
+
+static int heap_push(heap_t *h, const event_t *e)
+{
+    long i;
+
+    if (h->n == h->cap) {
+        long cap = h->cap ? 2 * h->cap : 1024;
+        event_t *ev = realloc(h->ev, cap * sizeof(*ev));
+
+        if (ev == NULL)
+            return -1;
+        h->ev = ev;
+        h->cap = cap;
+    }
+    for (i = h->n++; i > 0 && ev_before(e, &h->ev[(i - 1) / 2]);
+         i = (i - 1) / 2)
+        h->ev[i] = h->ev[(i - 1) / 2];
+    h->ev[i] = *e;
+    return 0;
+}
+
+static void heap_pop(heap_t *h, event_t *e)
+{
+    event_t last = h->ev[--h->n];
+    long i = 0, c;
+
+    *e = h->ev[0];
+    while ((c = 2 * i + 1) < h->n) {
+        if (c + 1 < h->n && ev_before(&h->ev[c + 1], &h->ev[c]))
+            c++;
+        if (!ev_before(&h->ev[c], &last))
+            break;
+        h->ev[i] = h->ev[c];
+        i = c;
+    }
+    if (h->n > 0)
+        h->ev[i] = last;
+}
+
+/*
+ * Output
+ */
+static int emit(out_t *o, int type, int index, size_t size)
+{
+    if (o->n == o->cap) {
+        long cap = o->cap ? 2 * o->cap : 4096;
+        btrace_op_t *ops;
+
+        if (cap > 0x7fffffff)
+            return -1;
+        if ((ops = realloc(o->ops, cap * sizeof(*ops))) == NULL)
+            return -1;
+        o->ops = ops;
+        o->cap = cap;
+    }
+    o->ops[o->n].type = type;
+    o->ops[o->n].index = index;
+    o->ops[o->n].size = type == BTRACE_FREE ? 0 : size;
+    o->n++;
+    return 0;
+}
+
+static int get_id(out_t *o)
+{
+    if (o->nfree > 0)
+        return o->free_ids[--o->nfree];
+    return o->next_id++;
+}
+
+static int put_id(out_t *o, int id)
+{
+    if (o->nfree == o->free_cap) {
+        int cap = o->free_cap ? 2 * o->free_cap : 1024;
+        int *ids = realloc(o->free_ids, cap * sizeof(*ids));
+
+        if (ids == NULL)
+            return -1;
+        o->free_ids = ids;
+        o->free_cap = cap;
+    }
+    o->free_ids[o->nfree++] = id;
+    return 0;
+}
+
+/* issue an event, return -1 if out of memory */
+static int run_event(out_t *o, const event_t *e)
+{
+    if (e->type == EV_DROP)
+        return put_id(o, e->index);
+    if (emit(o, e->type, e->index, e->size) < 0)
+        return -1;
+    if (e->type == BTRACE_FREE)
+        return put_id(o, e->index);
+    return 0;
+}
+
+/*
+ * Spec parsing
+ */
+static int spec_error(char *err, size_t errlen, const char *file, int line,
+                      const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    n = snprintf(err, errlen, "%s:%d: ", file, line);
+    if (n < 0 || (size_t)n >= errlen)
+        return -1;
+    va_start(ap, fmt);
+    vsnprintf(err + n, errlen - n, fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static int parse_long(const char *s, long *v)
+{
+    char *end;
+
+    errno = 0;
+    *v = strtol(s, &end, 10);
+    return s == end || *end != '\0' || errno != 0 ? -1 : 0;
+}
+
+static int parse_double(const char *s, double *v)
+{
+    char *end;
+
+    errno = 0;
+    *v = strtod(s, &end);
+    return s == end || *end != '\0' || errno != 0 ? -1 : 0;
+}
+
+/* parse "<lo>[-<hi>]:<w>" tokens from strtok into h */
+static int parse_hist(hist_t *h, long min, long max)
+{
+    char *tok, *colon, *dash;
+    bin_t *b;
+
+    h->nbins = 0;
+    h->total = 0;
+    while ((tok = strtok(NULL, " \t\n")) != NULL) {
+        if (h->nbins == MAXBINS)
+            return -1;
+        b = &h->bin[h->nbins];
+        if ((colon = strchr(tok, ':')) == NULL)
+            return -1;
+        *colon = '\0';
+        if (parse_double(colon + 1, &b->w) < 0 || b->w <= 0)
+            return -1;
+        if ((dash = strchr(tok, '-')) != NULL)
+            *dash = '\0';
+        if (parse_long(tok, &b->lo) < 0)
+            return -1;
+        b->hi = b->lo;
+        if (dash != NULL && parse_long(dash + 1, &b->hi) < 0)
+            return -1;
+        if (b->lo < min || b->hi > max || b->lo > b->hi)
+            return -1;
+        h->total += b->w;
+        h->nbins++;
+    }
+    return h->nbins > 0 ? 0 : -1;
+}
+
+/* the next token of the line as a long in [min, max] */
+static int next_long(long *v, long min, long max)
+{
+    char *tok = strtok(NULL, " \t\n");
+
+    return tok == NULL || parse_long(tok, v) < 0 || *v < min || *v > max ?
+        -1 : 0;
+}
+
+static int next_double(double *v)
+{
+    char *tok = strtok(NULL, " \t\n");
+
+    return tok == NULL || parse_double(tok, v) < 0 ? -1 : 0;
+}
+
+/*
+ * parse_spec - read the phases of a spec file into a malloc'd array
+ */
+static int parse_spec(const char *specfile, phase_t **phases, int *nphases,
+                      long *seed, int *weight, char *err, size_t errlen)
+{
+    FILE *f;
+    char buf[MAXLINE], *cmd, *p;
+    phase_t cur, *ph = NULL, *tmp;
+    int n = 0, line = 0;
+    long v;
+
+    memset(&cur, 0, sizeof(cur));
+    cur.sizes.nbins = 1;
+    cur.sizes.bin[0].lo = 16;
+    cur.sizes.bin[0].hi = 256;
+    cur.sizes.bin[0].w = cur.sizes.total = 1;
+    cur.life = LIFE_UNIFORM;
+    cur.life_a = 1;
+    cur.life_b = 100;
+    *seed = 1;
+    *weight = 1;
+
+    if ((f = fopen(specfile, "r")) == NULL) {
+        snprintf(err, errlen, "%s: %s", specfile, strerror(errno));
+        return -1;
+    }
+
+#define SPEC_FAIL(...) do { \
+        spec_error(err, errlen, specfile, line, __VA_ARGS__); \
+        goto fail; \
+    } while (0)
+
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        line++;
+        if ((p = strchr(buf, '#')) != NULL)
+            *p = '\0';
+        if ((cmd = strtok(buf, " \t\n")) == NULL)
+            continue;
+
+        if (strcmp(cmd, "seed") == 0) {
+            if (next_long(seed, 0, 0x7fffffffL) < 0)
+                SPEC_FAIL("seed needs a number");
+        } else if (strcmp(cmd, "weight") == 0) {
+            if (next_long(&v, 0, 0x7fffffffL) < 0)
+                SPEC_FAIL("weight needs a number");
+            *weight = v;
+        } else if (strcmp(cmd, "phase") == 0) {
+            /* the previous phase is complete, start a copy of it */
+            if (next_long(&cur.allocs, 1, 0x7fffffffL) < 0)
+                SPEC_FAIL("phase needs a positive number of allocations");
+            if ((tmp = realloc(ph, (n + 1) * sizeof(*ph))) == NULL)
+                SPEC_FAIL("out of memory");
+            ph = tmp;
+            ph[n++] = cur;
+        } else if (strcmp(cmd, "sizes") == 0) {
+            if (parse_hist(&cur.sizes, 1, MAXSIZE) < 0)
+                SPEC_FAIL("sizes needs <size>[-<max>]:<weight> ... "
+                          "with at most %d bins", MAXBINS);
+        } else if (strcmp(cmd, "lifetime") == 0) {
+            if ((p = strtok(NULL, " \t\n")) == NULL)
+                SPEC_FAIL("lifetime needs fixed, uniform, exp or hist");
+            if (strcmp(p, "fixed") == 0) {
+                cur.life = LIFE_FIXED;
+                if (next_long(&cur.life_a, 1, 0x7fffffffL) < 0)
+                    SPEC_FAIL("lifetime fixed needs a positive number");
+            } else if (strcmp(p, "uniform") == 0) {
+                cur.life = LIFE_UNIFORM;
+                if (next_long(&cur.life_a, 1, 0x7fffffffL) < 0 ||
+                    next_long(&cur.life_b, cur.life_a, 0x7fffffffL) < 0)
+                    SPEC_FAIL("lifetime uniform needs <min> <max>");
+            } else if (strcmp(p, "exp") == 0) {
+                cur.life = LIFE_EXP;
+                if (next_double(&cur.life_mean) < 0 || cur.life_mean <= 0)
+                    SPEC_FAIL("lifetime exp needs a positive mean");
+            } else if (strcmp(p, "hist") == 0) {
+                cur.life = LIFE_HIST;
+                if (parse_hist(&cur.life_hist, 1, 0x7fffffffL) < 0)
+                    SPEC_FAIL("lifetime hist needs <n>[-<m>]:<weight> ...");
+            } else {
+                SPEC_FAIL("unknown lifetime %s", p);
+            }
+        } else if (strcmp(cmd, "pattern") == 0) {
+            if ((p = strtok(NULL, " \t\n")) == NULL)
+                SPEC_FAIL("pattern needs random, fifo, lifo or region");
+            if (strcmp(p, "random") == 0) {
+                cur.pattern = PAT_RANDOM;
+            } else if (strcmp(p, "fifo") == 0 || strcmp(p, "lifo") == 0 ||
+                       strcmp(p, "region") == 0) {
+                cur.pattern = p[0] == 'f' ? PAT_FIFO :
+                    p[0] == 'l' ? PAT_LIFO : PAT_REGION;
+                if (next_long(&cur.batch, 1, 0x7fffffffL) < 0)
+                    SPEC_FAIL("pattern %s needs a positive depth", p);
+            } else {
+                SPEC_FAIL("unknown pattern %s", p);
+            }
+        } else if (strcmp(cmd, "realloc") == 0) {
+            if (next_double(&cur.re_prob) < 0 || cur.re_prob < 0 ||
+                cur.re_prob > 1 || next_double(&cur.re_factor) < 0 ||
+                cur.re_factor <= 0 || next_long(&v, 0, 64) < 0)
+                SPEC_FAIL("realloc needs <prob> <factor> <steps>");
+            cur.re_steps = v;
+        } else if (strcmp(cmd, "calloc") == 0) {
+            if (next_double(&cur.calloc_prob) < 0 || cur.calloc_prob < 0 ||
+                cur.calloc_prob > 1)
+                SPEC_FAIL("calloc needs <prob>");
+        } else {
+            SPEC_FAIL("unknown directive %s", cmd);
+        }
+        if (strcmp(cmd, "phase") != 0 && n > 0)
+            ph[n - 1] = cur;
+        if (strtok(NULL, " \t\n") != NULL)
+            SPEC_FAIL("trailing junk after %s", cmd);
+    }
+#undef SPEC_FAIL
+
+    fclose(f);
+    if (n == 0) {
+        spec_error(err, errlen, specfile, line, "no phase in the spec");
+        free(ph);
+        return -1;
+    }
+    *phases = ph;
+    *nphases = n;
+    return 0;
+
+ fail:
+    fclose(f);
+    free(ph);
+    return -1;
+}
+
+/*
+ * Generation
+ */
+
+/* schedule the reallocs and the free of a block allocated at time now,
+   in a region until region_end if that is later than now */
+static int schedule(heap_t *h, const phase_t *ph, long now, long *seq,
+                    int id, size_t size, long region_end)
+{
+    event_t e;
+    long life, k, order;
+    double sz = size;
+
+    if (region_end > now) {
+        /* a region block that outlives the region goes with it */
+        life = pick_life(ph);
+        e.type = now + life < region_end ? BTRACE_FREE : EV_DROP;
+        e.index = id;
+        e.size = 0;
+        e.time = e.type == BTRACE_FREE ? now + life : region_end;
+        e.order = e.seq = (*seq)++;
+        return heap_push(h, &e);
+    }
+
+    switch (ph->pattern) {
+    case PAT_FIFO:
+        life = ph->batch;
+        break;
+    case PAT_LIFO:
+        /* the whole batch goes at the end of it, newest first */
+        life = ph->batch - now % ph->batch;
+        break;
+    default:
+        life = pick_life(ph);
+    }
+
+    /* lifo orders its frees newest block first; a block's reallocs share
+       the order of its free so they can't sort after it */
+    order = *seq;
+    if (ph->pattern == PAT_LIFO)
+        order = -(*seq + ph->re_steps);
+
+    e.index = id;
+    e.time = now;
+    e.order = order;
+    if (ph->re_steps > 0 && rng_unit() < ph->re_prob) {
+        for (k = 1; k <= ph->re_steps; k++) {
+            sz *= ph->re_factor;
+            e.type = BTRACE_REALLOC;
+            e.size = sz > MAXSIZE ? MAXSIZE : sz < 1 ? 1 : (size_t)sz;
+            e.time = now + life * k / (ph->re_steps + 1);
+            if (e.time <= now)
+                e.time = now + 1;
+            e.seq = (*seq)++;
+            if (heap_push(h, &e) < 0)
+                return -1;
+        }
+    }
+    e.type = BTRACE_FREE;
+    e.size = 0;
+    if (e.time < now + life)
+        e.time = now + life;
+    e.seq = (*seq)++;
+    return heap_push(h, &e);
+}
+
+int gen_trace(const char *specfile, long seed, btrace_hdr_t *hdr,
+              btrace_op_t **ops, char *err, size_t errlen)
+{
+    phase_t *phases;
+    heap_t heap = { NULL, 0, 0 };
+    out_t out;
+    event_t e;
+    long spec_seed, now = 0, seq = 0, i, end, region_end = 0;
+    int nphases, weight, p, id, type;
+    size_t size;
+
+    if (parse_spec(specfile, &phases, &nphases, &spec_seed, &weight,
+                   err, errlen) < 0)
+        return -1;
+    rng_seed(seed >= 0 ? seed : spec_seed);
+    memset(&out, 0, sizeof(out));
+
+    for (p = 0; p < nphases; p++) {
+        end = now + phases[p].allocs;
+        for (i = 0; i < phases[p].allocs; i++, now++) {
+            while (heap.n > 0 && heap.ev[0].time <= now) {
+                heap_pop(&heap, &e);
+                if (run_event(&out, &e) < 0)
+                    goto nomem;
+            }
+            size = hist_pick(&phases[p].sizes);
+            id = get_id(&out);
+            if (id > BTRACE_INDEX) {
+                snprintf(err, errlen, "%s: more than %d live blocks",
+                         specfile, BTRACE_INDEX);
+                goto fail;
+            }
+            /* no draw without callocs, old specs keep their traces */
+            type = phases[p].calloc_prob > 0 &&
+                rng_unit() < phases[p].calloc_prob ?
+                BTRACE_CALLOC : BTRACE_ALLOC;
+            if (phases[p].pattern == PAT_REGION && type == BTRACE_ALLOC &&
+                region_end <= now) {
+                /* open a region up to the next multiple of batch, and
+                   end it after that time's frees */
+                region_end = (now / phases[p].batch + 1) * phases[p].batch;
+                if (region_end > end)
+                    region_end = end;
+                e.type = BTRACE_ARENA_END;
+                e.index = 0;
+                e.size = 0;
+                e.time = region_end;
+                e.order = LONG_MAX;
+                e.seq = seq++;
+                if (emit(&out, BTRACE_ARENA_BEGIN, 0, 0) < 0 ||
+                    heap_push(&heap, &e) < 0)
+                    goto nomem;
+            }
+            if (emit(&out, type, id, size) < 0 ||
+                schedule(&heap, &phases[p], now, &seq, id, size,
+                         type == BTRACE_ALLOC ? region_end : 0) < 0)
+                goto nomem;
+        }
+    }
+    while (heap.n > 0) {
+        heap_pop(&heap, &e);
+        if (run_event(&out, &e) < 0)
+            goto nomem;
+    }
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->weight = weight;
+    hdr->num_ops = out.n;
+    hdr->max_id = out.next_id > 0 ? out.next_id - 1 : 0;
+    *ops = out.ops;
+    free(out.free_ids);
+    free(heap.ev);
+    free(phases);
+    return 0;
+
+ nomem:
+    snprintf(err, errlen, "%s: out of memory, or more than %d requests",
+             specfile, 0x7fffffff);
+ fail:
+    free(out.ops);
+    free(out.free_ids);
+    free(heap.ev);
+    free(phases);
+    return -1;
+}
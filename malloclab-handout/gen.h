@@ -0,0 +1,15 @@
+/*
+ * gen.h - synthetic trace generator, see gen.c for the spec format
+ */
+#include <stddef.h>
+
+#include "tracefile.h"
+
+/*
+ * gen_trace - generate the trace described by the spec file. A seed of
+ *     -1 uses the spec's own seed. On success fill in hdr, point *ops at
+ *     a malloc'd array of hdr->num_ops requests and return 0; otherwise
+ *     write a message to err and return -1.
+ */
+int gen_trace(const char *specfile, long seed, btrace_hdr_t *hdr,
+              btrace_op_t **ops, char *err, size_t errlen);
@@ -0,0 +1,73 @@
+/*
+ * gentrace - generate a synthetic trace from a workload spec (see gen.c
+ * for the format) and write it as a .rep file or a binary trace.
+ *
+ * usage: gentrace [-bd] [-s <seed>] <spec> <out>
+ *   -b  write the binary format of tracefile.h instead of .rep text
+ *   -d  write the delta encoded binary format (implies -b)
+ *   -s  override the spec's seed; the same seed gives the same trace
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gen.h"
+
+#define MAXLINE 1024
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-bd] [-s <seed>] <spec> <out>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *out;
+    btrace_hdr_t hdr;
+    btrace_op_t *ops;
+    char err[MAXLINE];
+    long seed = -1;
+    int binary = 0, delta = 0, c, rc;
+
+    while ((c = getopt(argc, argv, "bds:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            binary = 1;
+            break;
+        case 'd':
+            binary = delta = 1;
+            break;
+        case 's':
+            seed = atol(optarg);
+            if (seed < 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+
+    if (gen_trace(argv[optind], seed, &hdr, &ops, err, sizeof(err)) < 0) {
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+        perror(argv[optind + 1]);
+        exit(1);
+    }
+    rc = binary ? btrace_write(out, &hdr, ops, delta) :
+        rep_write(out, &hdr, ops);
+    if (rc < 0 || fclose(out) != 0) {
+        fprintf(stderr, "%s: write failed\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    printf("%s: %d requests, %d ids\n", argv[optind + 1], hdr.num_ops,
+           hdr.max_id + 1);
+    free(ops);
+    return 0;
+}
@@ -10,20 +10,27 @@
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
+#include "tracefile.h"
+#include "gen.h"
 
 /**********************
  * Constants and macros
@@ -43,6 +50,14 @@
 #define WUTIL 2
 #define WPERF 3
 
+/* -T mode: number of timed runs, the best one is reported */
+#define MT_RUNS 3
+
+/* -X mode: cross thread frees are sent in batches of XFREE_BATCH, and
+   a thread looks for frees sent to it every XFREE_POLL + 1 requests */
+#define XFREE_BATCH 64
+#define XFREE_POLL  63
+
 /******************************
  * The key compound data types
  *****************************/
@@ -54,29 +69,48 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, a node of a treap
+   ordered by lo */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
+    unsigned int prio;     /* above the priorities of the subtrees */
     int index;             /* same index as free; for debugging */
 } range_t;
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, CALLOC, ARENA_BEGIN, ARENA_END,
+           ARENA_ALLOC, ARENA_FREE } type; /* type of request, the last
+                                 two are allocs and frees in a region */
     int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
 } traceop_t;
 
+/* A plain binary trace is replayed in place, its records must match */
+_Static_assert(sizeof(traceop_t) == sizeof(btrace_op_t) &&
+               offsetof(traceop_t, index) == offsetof(btrace_op_t, index) &&
+               offsetof(traceop_t, size) == offsetof(btrace_op_t, size) &&
+               ALLOC == BTRACE_ALLOC && FREE == BTRACE_FREE &&
+               REALLOC == BTRACE_REALLOC && CALLOC == BTRACE_CALLOC &&
+               ARENA_BEGIN == BTRACE_ARENA_BEGIN &&
+               ARENA_END == BTRACE_ARENA_END,
+               "traceop_t is not btrace_op_t");
+
 /* Holds the information for one trace file*/
 typedef struct {
     char filename[MAXLINE];
-    int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+    int ignore_ranges;   /* too big for the old list checker, unused */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
+    int *arena_ids;      /* ids a region still holds at its end, the
+                            ARENA_END requests index into it */
+    void *map;           /* mapped binary trace ops points into, or NULL */
+    size_t map_len;
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
@@ -92,6 +126,102 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* The allocator a -T mode thread calls, mm or libc */
+typedef struct {
+    int (*init)(void);          /* fresh heap before each run */
+    void *(*malloc)(size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*free)(void *ptr);
+    /* regions, NULL to replay them as plain mallocs and frees */
+    mm_arena_t *(*arena_create)(void);
+    void *(*arena_alloc)(mm_arena_t *a, size_t size);
+    void (*arena_destroy)(mm_arena_t *a);
+} allocator_t;
+
+/* Blocks other threads sent a -T mode thread to free (-X) */
+typedef struct {
+    pthread_mutex_t lock;
+    char **items;
+    int n, cap;
+} inbox_t;
+
+/* Holds the params of one replay thread in the -T mode */
+typedef struct thread {
+    const allocator_t *a;
+    traceop_t *ops;             /* requests this thread replays */
+    int num_ops;
+    int *arena_ids;             /* trace->arena_ids, for ARENA_END */
+    char **blocks;              /* this thread's copy of trace->blocks */
+    pthread_barrier_t *start;   /* released once every thread is ready */
+    pthread_barrier_t *done;    /* released once every thread has replayed */
+    struct timespec t0, t1;     /* when this thread started and finished */
+    int failed;                 /* the allocator ran out of memory */
+    struct thread *peer;        /* gets this thread's -X frees, or NULL */
+    char *out[XFREE_BATCH];     /* frees not yet sent to peer */
+    int num_out;
+    inbox_t inbox;              /* frees sent by the other threads */
+    char **spare;               /* swapped with inbox.items to drain it */
+    int spare_cap;
+} thread_t;
+
+/* One sample of the heap's footprint in the -M mode */
+typedef struct {
+    int op;                     /* ops replayed, -1 after mm_trim(0) */
+    size_t heap;                /* heap plus mapped bytes */
+    size_t rss;                 /* resident bytes of both */
+} rss_sample_t;
+
+/*
+ * Latency histograms of the -L mode, HDR style: values below
+ * 2^LAT_SUB_BITS get a bucket each, above that every power of two is
+ * split into 2^LAT_SUB_BITS linear buckets, so a bucket is within 1/16
+ * of any value in it
+ */
+#define LAT_SUB_BITS    4
+#define LAT_SUB         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS     ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+#define LAT_OPS         7       /* malloc, free, realloc, calloc, and the
+                                   region's alloc, create and destroy */
+#define LAT_CLASSES     6       /* request sizes <= 64, 512, 4K, 32K, 256K, more */
+#define LAT_MIN_SAMPLES 200000  /* replay small traces until this many ops */
+#define LAT_MAX_RUNS    100
+
+typedef struct {
+    unsigned long count[LAT_BUCKETS];
+    unsigned long n;
+    unsigned long long max;
+} lat_hist_t;
+
+/* Percentiles of one histogram, in cycles */
+typedef struct {
+    unsigned long n;
+    unsigned long long p50, p99, p999, max;
+} lat_summary_t;
+
+/* The request types of the -L mode, in the order of LAT_OPS */
+enum { LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_CALLOC, LAT_ARENA_ALLOC,
+       LAT_ARENA_CREATE, LAT_ARENA_DESTROY };
+
+/* Replay modes of replay_start */
+#define REPLAY_TOUCH    1       /* start with nothing resident and write
+                                   what is allocated, as a program would */
+#define REPLAY_TIMED    2       /* read the counter around each call */
+
+/* A replay of one trace on mm, request by request (replay_op) */
+typedef struct {
+    trace_t *trace;
+    int tracenum;
+    const char *caller;         /* named in the error messages */
+    int mode;                   /* REPLAY_ flags */
+    mm_arena_t *region;         /* the region open, or NULL */
+    size_t live;                /* payload bytes the trace holds */
+    /* the last request */
+    int op;                     /* its LAT_ type, -1 if it called nothing */
+    size_t size;                /* its size, of a free what it freed */
+    unsigned long long t0, t1;  /* the counter around the call if timed */
+} replay_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -102,9 +232,26 @@ typedef struct {
     /* run-time stats defined for both libc and student */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    perf_counts_t perf; /* hardware events of the run secs is from */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double mt_secs;  /* secs for num_threads concurrent runs (-T), < 0 if
+                        the heap ran out */
+    double *sweep[2]; /* secs of mm and libc for 1..sweep_max threads (-W) */
+    mm_tcache_stats_t tcache; /* thread cache counters of the util run */
+    mm_realloc_stats_t realloc; /* realloc counters of the util run */
+    unsigned long sbrks;        /* mem_sbrk calls of the util run */
+    size_t peak;                /* peak footprint of the util run */
+    rss_sample_t *rss;          /* footprint over the trace (-M) */
+    int num_rss;
+    /* latency per op type, of each size class and then of all (-L) */
+    lat_summary_t lat[LAT_OPS][LAT_CLASSES + 1];
+    /* the speed run on base pages, next to the one on huge pages (-U) */
+    double small_secs;
+    perf_counts_t small_perf;
+    int pages;                  /* what backed the huge page run */
+    size_t huge_bytes;          /* heap bytes in huge pages after it */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -137,6 +284,57 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* number of threads replaying each trace at once (-T), 0 is off */
+static int num_threads = 0;
+
+/* -T threads split the trace by block id instead of each replaying all
+   of it (-P), and send this percentage of their frees to the next
+   thread (-X) */
+static int split_flag = 0;
+static int xfree_pct = 0;
+
+/* sweep the thread count from 1 to sweep_max for mm and libc (-W) */
+static int sweep_flag = 0;
+static int sweep_max = 0;
+
+/* thread cache depth and refill batch (-C), depth < 0 keeps the default */
+static int tcache_depth = -1;
+static int tcache_fill = 0;
+
+/* blocks a quick list holds before it is merged (-Q), 0 is eager */
+static int quick_limit = 0;
+
+/* print the realloc counters (-R) */
+static int realloc_flag = 0;
+
+/* print the sbrk calls and peak footprint (-B) */
+static int sbrk_flag = 0;
+
+/* number of footprint samples per trace (-M), 0 is off */
+static int rss_samples = 0;
+
+/* write mm_stats every stats_every requests to stats_file (-H), 0 is off */
+static int stats_every = 0;
+static FILE *stats_file = NULL;
+
+/* sample about one allocation per prof_rate bytes and write the sites
+   of each trace to prof_file (-p), 0 is off */
+static size_t prof_rate = 0;
+static FILE *prof_file = NULL;
+
+/* time every request (-L), and the timer's own cost that is subtracted */
+static int latency_flag = 0;
+static unsigned long long lat_overhead = 0;
+
+/* what backs the heap (-U), each trace is timed on base pages too */
+static int huge_pages = MEM_PAGES_SMALL;
+
+/* replay the regions of a trace with mm_arena_*, or with -N as plain
+   mallocs and frees */
+static int arena_flag = 1;
+
+/* binary trace generated by -g, removed at exit */
+static char gen_file[MAXLINE];
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -157,17 +355,26 @@ static int add_range(range_t **ranges, char *lo, int size,
                      const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *range_below(range_t *r, char *addr);
+static void check_ranges(const trace_t *trace, int opnum, range_t *r);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
 static void check_index(const trace_t *trace, int opnum, int index);
+static void check_zero(const trace_t *trace, int opnum, int index);
 static void randomize_block(trace_t *trace, int index);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
+static void check_trace_header(trace_t *trace);
+static void parse_trace(trace_t *trace, FILE *tracefile);
+static void map_trace(trace_t *trace, FILE *tracefile);
+static void mark_arenas(trace_t *trace);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
+static void generate_trace(const char *arg);
+static void remove_gen_file(void);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace);
@@ -178,9 +385,34 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void *eval_mm_thread(void *ptr);
+static void *eval_libc_thread(void *ptr);
+static double eval_speed_mt(trace_t *trace, int nthreads,
+                            const allocator_t *a);
+static void eval_sweep(trace_t *trace, stats_t *stats);
+static int mm_reset(void);
+static int libc_reset(void);
+static void replay_start(replay_t *r, trace_t *trace, int tracenum,
+                         const char *caller, int mode);
+static void replay_op(replay_t *r, int i);
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats);
+static void eval_mm_stats(trace_t *trace, int tracenum);
+static void print_stats_header(void);
+static void eval_mm_profile(trace_t *trace, int tracenum);
+static void eval_mm_latency(trace_t *trace, int tracenum, stats_t *stats);
+static unsigned long long calibrate_latency(void);
+static void eval_mm_pages(speed_t *speed_params, stats_t *stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printresults_mt(int n, stats_t *stats);
+static void printresults_sweep(int n, stats_t *stats);
+static void printresults_tcache(int n, stats_t *stats);
+static void printresults_realloc(int n, stats_t *stats);
+static void printresults_sbrk(int n, stats_t *stats);
+static void printresults_rss(int n, stats_t *stats);
+static void printresults_latency(int n, stats_t *stats);
+static void printresults_pages(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -189,6 +421,15 @@ static void unix_error(const char *fmt, ...)
 static void app_error(const char *fmt, ...)
     __attribute__((format(printf, 1,2), noreturn));
 
+/* the allocators the -T mode replays on */
+static const allocator_t mm_allocator = {
+    mm_reset, mm_malloc, mm_calloc, mm_realloc, mm_free,
+    mm_arena_create, mm_arena_alloc, mm_arena_destroy
+};
+static const allocator_t libc_allocator = {
+    libc_reset, malloc, calloc, realloc, free, NULL, NULL, NULL
+};
+
 static sigjmp_buf timeout_jmpbuf;
 
 /* Timeout signal handler */
@@ -236,11 +477,31 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            mm_tcache_stats(&mm_stats[i].tcache);
+            mm_realloc_stats(&mm_stats[i].realloc);
+            mm_stats[i].sbrks = mem_sbrk_calls();
+            mm_stats[i].peak = mem_peak_footprint();
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            fsecs_counts(&mm_stats[i].perf);
+            if (huge_pages != MEM_PAGES_SMALL)
+                eval_mm_pages(speed_params, &mm_stats[i]);
+            if (num_threads > 0)
+                mm_stats[i].mt_secs = eval_speed_mt(trace, num_threads,
+                                                    &mm_allocator);
+            if (sweep_flag)
+                eval_sweep(trace, &mm_stats[i]);
+            if (rss_samples > 0)
+                eval_mm_rss(trace, i, &mm_stats[i]);
+            if (stats_every > 0)
+                eval_mm_stats(trace, i);
+            if (prof_rate > 0)
+                eval_mm_profile(trace, i);
+            if (latency_flag)
+                eval_mm_latency(trace, i, &mm_stats[i]);
         }
 
         free_trace(trace);
@@ -267,6 +528,8 @@ int main(int argc, char **argv)
 
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
     int autograder = 0;   /* if set then called by autograder (-A) */
+    size_t mmap_threshold; /* requests mapped directly (set by -m) */
+    size_t grow_cap;       /* most the heap grows by at once (set by -G) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput = 0, p1, p2, perfindex;
@@ -280,7 +543,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:g:s:t:v:G:H:K:T:C:M:m:O:Q:U:X:p:hVABlDLNPRSW")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -306,6 +569,16 @@ int main(int argc, char **argv)
             tracefiles[1] = NULL;
             break;
 
+        case 'g': /* Generate a trace from a workload spec and run it */
+            generate_trace(optarg);
+            num_tracefiles = 1;
+            if ((tracefiles = realloc(tracefiles, 2 * sizeof(char *))) == NULL)
+                unix_error("ERROR: realloc failed in main");
+            strcpy(tracedir, "");
+            tracefiles[0] = strdup(gen_file);
+            tracefiles[1] = NULL;
+            break;
+
         case 't': /* Directory where the traces are located */
             if (num_tracefiles == 1) /* ignore if -f already encountered */
                 break;
@@ -338,6 +611,150 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'C': /* Thread cache depth, optionally with the refill batch */
+            if (sscanf(optarg, "%d,%d", &tcache_depth, &tcache_fill) < 1 ||
+                tcache_depth < 0 || tcache_fill < 0)
+                app_error("-C needs <depth>[,<fill>]\n");
+            mm_set_tcache(tcache_depth, tcache_fill);
+            break;
+
+        case 'M': /* Sample the heap's footprint this many times a trace */
+            rss_samples = atoi(optarg);
+            if (rss_samples < 1)
+                app_error("-M needs a positive number of samples\n");
+            break;
+
+        case 'H': /* Write the heap layout every k requests to a CSV file */
+            {
+                char *comma = strchr(optarg, ',');
+                const char *name = comma ? comma + 1 : "mm-stats.csv";
+
+                stats_every = atoi(optarg);
+                if (stats_every < 1)
+                    app_error("-H needs <k>[,<file>]\n");
+                if (stats_file != NULL)
+                    fclose(stats_file);
+                if ((stats_file = fopen(name, "w")) == NULL)
+                    unix_error("Could not open %s for -H", name);
+            }
+            break;
+
+        case 'p': /* Profile the allocation sites, one sample per n bytes */
+            {
+                char *comma = strchr(optarg, ',');
+                const char *name = comma ? comma + 1 : "mm-profile.txt";
+
+                if (sscanf(optarg, "%zu", &prof_rate) != 1 || prof_rate == 0)
+                    app_error("-p needs <bytes>[,<file>]\n");
+                if (prof_file != NULL)
+                    fclose(prof_file);
+                if ((prof_file = fopen(name, "w")) == NULL)
+                    unix_error("Could not open %s for -p", name);
+            }
+            break;
+
+        case 'G': /* Grow the heap adaptively, by up to this many bytes */
+            if (sscanf(optarg, "%zu", &grow_cap) != 1)
+                app_error("-G needs a size in bytes, 0 grows by fixed chunks\n");
+            mm_set_growth(grow_cap);
+            break;
+
+        case 'N': /* Replay regions as plain mallocs and frees */
+            arena_flag = 0;
+            break;
+
+        case 'B': /* Print the sbrk calls */
+            sbrk_flag = 1;
+            break;
+
+        case 'U': /* Back the heap with huge pages */
+            if (strcmp(optarg, "thp") == 0)
+                huge_pages = MEM_PAGES_THP;
+            else if (strcmp(optarg, "hugetlb") == 0)
+                huge_pages = MEM_PAGES_HUGETLB;
+            else
+                app_error("-U needs thp or hugetlb\n");
+            mem_set_pages(huge_pages);
+            break;
+
+        case 'm': /* Map requests of this many bytes or more, 0 never */
+            if (sscanf(optarg, "%zu", &mmap_threshold) != 1)
+                app_error("-m needs a size in bytes\n");
+            mm_set_mmap_threshold(mmap_threshold);
+            break;
+
+        case 'O': /* Address order the seglists of these classes */
+            {
+                char *end;
+                unsigned long classes = strcmp(optarg, "all") == 0 ?
+                    ~0UL : strtoul(optarg, &end, 0);
+
+                if (strcmp(optarg, "all") != 0 &&
+                    (*optarg == '\0' || *end != '\0'))
+                    app_error("-O needs a class bit mask or all\n");
+                mm_set_list_order(classes);
+            }
+            break;
+
+        case 'Q': /* Defer coalescing, merge a quick list at n blocks */
+            if (sscanf(optarg, "%d", &quick_limit) != 1 || quick_limit < 0)
+                app_error("-Q needs a block count, 0 coalesces eagerly\n");
+            mm_set_deferred(quick_limit);
+            break;
+
+        case 'K': /* What mm_checkheap checks under -D */
+            {
+                char *comma = strchr(optarg, ',');
+                size_t len = comma ? (size_t)(comma - optarg) : strlen(optarg);
+                long window = comma ? atol(comma + 1) : 0;
+                int mode;
+
+                if (len == 4 && strncmp(optarg, "full", 4) == 0)
+                    mode = MM_CHECK_FULL;
+                else if (len == 3 && strncmp(optarg, "inc", 3) == 0)
+                    mode = MM_CHECK_INCREMENTAL;
+                else if (len == 6 && strncmp(optarg, "sample", 6) == 0)
+                    mode = MM_CHECK_SAMPLE;
+                else
+                    app_error("-K needs full, inc or sample[,<window>]\n");
+                if (window < 0)
+                    app_error("-K needs a positive sample window\n");
+                mm_set_check(mode, window);
+            }
+            break;
+
+        case 'S': /* Serve tiny requests from slab runs */
+            mm_set_slab(1);
+            break;
+
+        case 'L': /* Time every request */
+            latency_flag = 1;
+            break;
+
+        case 'R': /* Print the realloc counters */
+            realloc_flag = 1;
+            break;
+
+        case 'T': /* Also replay each trace from this many threads */
+            num_threads = atoi(optarg);
+            if (num_threads < 1)
+                app_error("-T needs a positive number of threads\n");
+            break;
+
+        case 'P': /* -T threads split each trace between them */
+            split_flag = 1;
+            break;
+
+        case 'X': /* -T threads free this percent of blocks remotely */
+            xfree_pct = atoi(optarg);
+            if (xfree_pct < 0 || xfree_pct > 100)
+                app_error("-X needs a percentage\n");
+            break;
+
+        case 'W': /* Sweep the thread count, mm against libc */
+            sweep_flag = 1;
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -348,6 +765,16 @@ int main(int argc, char **argv)
         }
     }
 
+    if (sweep_flag) {
+        /* up to -T threads, or one per online CPU */
+        sweep_max = num_threads;
+        if (sweep_max == 0 && (sweep_max = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+            sweep_max = 1;
+    }
+
+    if (stats_file != NULL)
+        print_stats_header();
+
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
@@ -360,6 +787,8 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (latency_flag)
+        lat_overhead = calibrate_latency();
 
     /* Initialize the timeout */
     if (set_timeout > 0) {
@@ -391,6 +820,7 @@ int main(int argc, char **argv)
                 if (verbose > 1)
                     printf("and performance.\n");
                 libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                fsecs_counts(&libc_stats[i].perf);
             }
             free_trace(trace);
         }
@@ -430,6 +860,52 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats);
             printf("\n");
+            if (num_threads > 0) {
+                printf("Results for mm malloc with %d threads%s:\n",
+                       num_threads, split_flag ? " splitting each trace" : "");
+                printresults_mt(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (sweep_flag) {
+                printf("Thread sweep, mm against libc malloc%s, %d%% of "
+                       "frees cross threads:\n",
+                       split_flag ? " splitting each trace" : "", xfree_pct);
+                printresults_sweep(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (tcache_depth >= 0) {
+                printf("Thread cache with depth %d, refill %d:\n",
+                       tcache_depth, tcache_fill);
+                printresults_tcache(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (realloc_flag) {
+                printf("Realloc counters:\n");
+                printresults_realloc(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (sbrk_flag) {
+                printf("Heap growth:\n");
+                printresults_sbrk(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (rss_samples > 0) {
+                printf("Heap footprint over each trace:\n");
+                printresults_rss(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (latency_flag) {
+                printf("Latency in cycles, %llu cycles of timer overhead "
+                       "subtracted:\n", lat_overhead);
+                printresults_latency(num_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (huge_pages != MEM_PAGES_SMALL) {
+                printf("Base pages against huge pages, dTLB misses per "
+                       "request:\n");
+                printresults_pages(num_tracefiles, mm_stats);
+                printf("\n");
+            }
         }
     }
 
@@ -546,11 +1022,16 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. It is a
+ * treap keyed by the low address, with a priority hashed from it like
+ * the size tree of mm.c, so each operation takes O(log n) expected.
  ****************************************************************/
 
+/* treap priority of a range starting at lo */
+#define RANGE_PRIO(lo) ((unsigned int)((size_t)(lo) >> 3) * 2654435761U)
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
@@ -572,62 +1053,115 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_is_mapped(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
-       just assume the overlap will be caught by writing random bits. */
-    if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
+    if(debug_mode == DBG_NONE) return 1;
 
-
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-            malloc_error(trace, opnum,
-                         "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                         lo, hi, p->lo, p->hi);
-            return 0;
-        }
+    /* The payload must not overlap any other payloads. They don't
+       overlap each other, so only the last one starting at or below
+       hi can reach lo */
+    if ((p = range_below(*ranges, hi)) != NULL && p->hi >= lo) {
+        malloc_error(trace, opnum,
+                     "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                     lo, hi, p->lo, p->hi);
+        return 0;
     }
 
     /*
      * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it to the range tree.
+     * Walk down to where it sorts, as long as it would go below the
+     * node, then split that subtree around lo under the new node.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
+    p->prio = RANGE_PRIO(lo);
     p->index = index;
+    while (*ranges != NULL && (*ranges)->prio > p->prio)
+        ranges = lo < (*ranges)->lo ? &(*ranges)->left : &(*ranges)->right;
+    {
+        range_t *t = *ranges;
+        range_t **leftp = &p->left;
+        range_t **rightp = &p->right;
+
+        while (t != NULL) {
+            if (t->lo < lo) {
+                *leftp = t;
+                leftp = &t->right;
+                t = t->right;
+            } else {
+                *rightp = t;
+                rightp = &t->left;
+                t = t->left;
+            }
+        }
+        *leftp = *rightp = NULL;
+    }
     *ranges = p;
 
     return 1;
 }
 
+/*
+ * range_below - the range with the highest low address at or below
+ *     addr, NULL if there is none
+ */
+static range_t *range_below(range_t *r, char *addr)
+{
+    range_t *below = NULL;
+
+    while (r != NULL) {
+        if (r->lo <= addr) {
+            below = r;
+            r = r->right;
+        } else {
+            r = r->left;
+        }
+    }
+    return below;
+}
+
 /*
  * remove_range - Free the range record of block whose payload starts at lo
  */
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            free(p);
-            break;
+    while (*ranges != NULL && (*ranges)->lo != lo)
+        ranges = lo < (*ranges)->lo ? &(*ranges)->left : &(*ranges)->right;
+    if ((p = *ranges) == NULL)
+        return;
+
+    /* Merge its subtrees in its place, by priority */
+    {
+        range_t *l = p->left;
+        range_t *r = p->right;
+
+        while (l != NULL && r != NULL) {
+            if (l->prio > r->prio) {
+                *ranges = l;
+                ranges = &l->right;
+                l = l->right;
+            } else {
+                *ranges = r;
+                ranges = &r->left;
+                r = r->left;
+            }
         }
-        prevpp = &(p->next);
+        *ranges = l != NULL ? l : r;
     }
+    free(p);
 }
 
 /*
@@ -635,14 +1169,23 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    if (*ranges == NULL)
+        return;
+    clear_ranges(&(*ranges)->left);
+    clear_ranges(&(*ranges)->right);
+    free(*ranges);
+    *ranges = NULL;
+}
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+/*
+ * check_ranges - check the data of every block in the range tree r
+ */
+static void check_ranges(const trace_t *trace, int opnum, range_t *r)
+{
+    for (; r != NULL; r = r->right) {
+        check_ranges(trace, opnum, r->left);
+        check_index(trace, opnum, r->index);
     }
-    *ranges = NULL;
 }
 
 /**********************************************
@@ -707,22 +1250,34 @@ static void check_index(const trace_t *trace, int opnum, int index) {
     }
 }
 
+/* check_zero - a calloc'd block has to read as zero, debug mode or not */
+static void check_zero(const trace_t *trace, int opnum, int index) {
+    const unsigned char *block = (const unsigned char *)trace->blocks[index];
+    size_t i;
+
+    for(i = 0; i < trace->block_sizes[index]; i++) {
+        if(block[i] != 0) {
+            malloc_error(trace, opnum, "mm_calloc block %d is not zero at "
+                         "byte %zu", index, i);
+            return;
+        }
+    }
+}
+
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. A binary trace
+ *     (see tracefile.h) is mapped instead of parsed.
  */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
-    int index, size;
-    int max_index = 0;
-    int op_index;
+    char magic[sizeof(BTRACE_MAGIC)];
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
@@ -731,28 +1286,21 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trace");
 
-    /* Read the trace file header */
     strcpy(trace->filename, tracedir);
     strcat(trace->filename, filename);
     if ((tracefile = fopen(trace->filename, "r")) == NULL) {
         unix_error("Could not open %s in read_trace", trace->filename);
     }
-    fscanf(tracefile, "%d", &trace->weight);
-    fscanf(tracefile, "%d", &trace->num_ids);
-    fscanf(tracefile, "%d", &trace->num_ops);
-    fscanf(tracefile, "%d", &trace->ignore_ranges);
-
-    if(trace->weight < 0 || trace->weight > 3) {
-        app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
-    }
-    if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
-        app_error("%s: ignore-ranges can only be zero or one", trace->filename);
+    trace->map = NULL;
+    if (fread(magic, sizeof(magic), 1, tracefile) == 1 &&
+        memcmp(magic, BTRACE_MAGIC, sizeof(magic)) == 0) {
+        map_trace(trace, tracefile);
+    } else {
+        rewind(tracefile);
+        parse_trace(trace, tracefile);
     }
-
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops =
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
+    fclose(tracefile);
+    mark_arenas(trace);
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks =
@@ -769,6 +1317,48 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
+    /* fill in the stats */
+    strcpy(stats->filename, trace->filename);
+    stats->weight = trace->weight;
+    stats->ops = trace->num_ops;
+
+    return trace;
+}
+
+/*
+ * check_trace_header - reject header values the evaluation can't use
+ */
+static void check_trace_header(trace_t *trace)
+{
+    if(trace->weight < 0 || trace->weight > 3) {
+        app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
+    }
+    if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
+        app_error("%s: ignore-ranges can only be zero or one", trace->filename);
+    }
+}
+
+/*
+ * parse_trace - read the header and requests of a .rep text trace
+ */
+static void parse_trace(trace_t *trace, FILE *tracefile)
+{
+    char type[MAXLINE];
+    int index, size;
+    int max_index = 0;
+    int op_index;
+
+    /* Read the trace file header */
+    fscanf(tracefile, "%d", &trace->weight);
+    fscanf(tracefile, "%d", &trace->num_ids);
+    fscanf(tracefile, "%d", &trace->num_ops);
+    fscanf(tracefile, "%d", &trace->ignore_ranges);
+    check_trace_header(trace);
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+        unix_error("malloc 2 failed in read_trace");
 
     /* read every request line in the trace file */
     index = 0;
@@ -782,6 +1372,13 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'c':
+            fscanf(tracefile, "%u %u", &index, &size);
+            trace->ops[op_index].type = CALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
         case 'r':
             fscanf(tracefile, "%u %u", &index, &size);
             trace->ops[op_index].type = REALLOC;
@@ -794,6 +1391,12 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
             break;
+        case 'b':
+        case 'e':
+            trace->ops[op_index].type = type[0] == 'b' ? ARENA_BEGIN : ARENA_END;
+            trace->ops[op_index].index = 0;
+            trace->ops[op_index].size = 0;
+            break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
@@ -801,16 +1404,220 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
         op_index++;
         if(op_index == trace->num_ops) break;
     }
-    fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+}
 
-    /* fill in the stats */
-    strcpy(stats->filename, trace->filename);
-    stats->weight = trace->weight;
-    stats->ops = trace->num_ops;
+/*
+ * map_trace - map a binary trace. Plain records are replayed where they
+ *     are, delta encoded ones are decoded into an array first. Either
+ *     way the ids are range checked once here, not on every replay.
+ */
+static void map_trace(trace_t *trace, FILE *tracefile)
+{
+    struct stat st;
+    btrace_hdr_t *hdr;
+    size_t rec_size;
+    int i;
 
-    return trace;
+    if (fstat(fileno(tracefile), &st) < 0)
+        unix_error("Could not stat %s in read_trace", trace->filename);
+    if ((size_t)st.st_size < sizeof(btrace_hdr_t))
+        app_error("%s: truncated binary trace header", trace->filename);
+    trace->map_len = st.st_size;
+    /* writable, mark_arenas rewrites the requests of a region */
+    trace->map = mmap(NULL, trace->map_len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fileno(tracefile), 0);
+    if (trace->map == MAP_FAILED)
+        unix_error("Could not map %s in read_trace", trace->filename);
+
+    hdr = trace->map;
+    if (hdr->version != BTRACE_VERSION)
+        app_error("%s: binary trace version %u, expected %d",
+                  trace->filename, hdr->version, BTRACE_VERSION);
+    trace->weight = hdr->weight;
+    trace->ignore_ranges = hdr->ignore_ranges;
+    trace->num_ops = hdr->num_ops;
+    trace->num_ids = hdr->max_id + 1;
+    check_trace_header(trace);
+
+    rec_size = (hdr->flags & BTRACE_DELTA) ?
+        sizeof(btrace_dop_t) : sizeof(btrace_op_t);
+    if (trace->num_ops < 0 || trace->num_ids < 1 ||
+        trace->map_len != sizeof(*hdr) + trace->num_ops * rec_size)
+        app_error("%s: binary trace size doesn't match its header",
+                  trace->filename);
+
+    if (hdr->flags & BTRACE_DELTA) {
+        btrace_dop_t *d = (btrace_dop_t *)(hdr + 1);
+        int64_t size = 0;
+
+        if ((trace->ops = malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+            unix_error("malloc 2 failed in read_trace");
+        for (i = 0; i < trace->num_ops; i++) {
+            trace->ops[i].type = BTRACE_DOP_TYPE(d[i].op);
+            trace->ops[i].index = BTRACE_DOP_INDEX(d[i].op);
+            trace->ops[i].size = 0;
+            if (trace->ops[i].type == FREE &&
+                trace->ops[i].index < -1) {
+                trace->ops[i].type =
+                    trace->ops[i].index == BTRACE_DOP_BEGIN_ID ?
+                    ARENA_BEGIN : ARENA_END;
+                trace->ops[i].index = 0;
+            } else if (trace->ops[i].type != FREE) {
+                size += d[i].dsize;
+                trace->ops[i].size = size;
+            }
+        }
+        munmap(trace->map, trace->map_len);
+        trace->map = NULL;
+    } else {
+        trace->ops = (traceop_t *)(hdr + 1);
+    }
+
+    for (i = 0; i < trace->num_ops; i++) {
+        traceop_t *op = &trace->ops[i];
+
+        if ((unsigned int)op->type > ARENA_END ||
+            op->index >= trace->num_ids ||
+            op->index < (op->type == FREE ? -1 : 0))
+            app_error("%s: bad request %d in binary trace",
+                      trace->filename, i);
+    }
+}
+
+/*
+ * mark_arenas - check the regions of a trace and turn the allocs in
+ *     them, and the frees of their blocks, into ARENA_ALLOC and
+ *     ARENA_FREE. Each ARENA_END gets the ids its region still holds,
+ *     as the start (index) and count (size) of a run of arena_ids, so
+ *     that a replay without mm_arena_destroy frees them one by one.
+ *     Regions don't nest, callocs in a region come from the heap, and
+ *     a region's blocks can't be realloc'd or used after its end.
+ */
+static void mark_arenas(trace_t *trace)
+{
+    int *region;    /* region an id is live in, 0 if none, -1 if ended */
+    int *ids;       /* the allocs of the open region */
+    int i, j, cur = 0, open = 0, n = 0, num_ids = 0;
+
+    trace->arena_ids = NULL;
+    for (i = 0; i < trace->num_ops; i++)
+        if (trace->ops[i].type == ARENA_BEGIN ||
+            trace->ops[i].type == ARENA_END)
+            break;
+    if (i == trace->num_ops)
+        return;
+
+    if ((region = calloc(trace->num_ids, sizeof(int))) == NULL ||
+        (ids = malloc(trace->num_ops * sizeof(int))) == NULL ||
+        (trace->arena_ids = malloc(trace->num_ops * sizeof(int))) == NULL)
+        unix_error("malloc failed in mark_arenas");
+    for (i = 0; i < trace->num_ops; i++) {
+        traceop_t *op = &trace->ops[i];
+
+        switch (op->type) {
+        case ARENA_BEGIN:
+            if (open)
+                app_error("%s: request %d begins a region in a region",
+                          trace->filename, i);
+            open = 1;
+            cur++;
+            n = 0;
+            break;
+        case ARENA_END:
+            if (!open)
+                app_error("%s: request %d ends no region",
+                          trace->filename, i);
+            op->index = num_ids;
+            for (j = 0; j < n; j++) {
+                if (region[ids[j]] == cur)
+                    trace->arena_ids[num_ids++] = ids[j];
+                if (region[ids[j]] != 0)
+                    region[ids[j]] = -1;
+            }
+            op->size = num_ids - op->index;
+            open = 0;
+            break;
+        case ALLOC:
+            region[op->index] = 0;
+            if (open) {
+                op->type = ARENA_ALLOC;
+                region[op->index] = cur;
+                ids[n++] = op->index;
+            }
+            break;
+        case CALLOC:
+            region[op->index] = 0;
+            break;
+        case REALLOC:
+            if (region[op->index] != 0)
+                app_error("%s: request %d reallocs a block of a region",
+                          trace->filename, i);
+            break;
+        case FREE:
+            if (op->index < 0 || region[op->index] == 0)
+                break;
+            if (region[op->index] != cur)
+                app_error("%s: request %d frees a block of an ended region",
+                          trace->filename, i);
+            op->type = ARENA_FREE;
+            region[op->index] = 0;
+            break;
+        default:
+            app_error("%s: bad request %d", trace->filename, i);
+        }
+    }
+    if (open)
+        app_error("%s: the trace ends in a region", trace->filename);
+    free(region);
+    free(ids);
+}
+
+/*
+ * generate_trace - generate the trace of "<spec>[,<seed>]" into a
+ *     temporary binary trace file named by gen_file
+ */
+static void generate_trace(const char *arg)
+{
+    char spec[MAXLINE], err[MAXLINE], *comma;
+    btrace_hdr_t hdr;
+    btrace_op_t *ops;
+    long seed = -1;
+    FILE *out;
+    int fd;
+
+    if (strlen(arg) >= sizeof(spec))
+        app_error("-g: spec name too long\n");
+    strcpy(spec, arg);
+    if ((comma = strrchr(spec, ',')) != NULL) {
+        *comma = '\0';
+        if (sscanf(comma + 1, "%ld", &seed) != 1 || seed < 0)
+            app_error("-g needs <spec>[,<seed>]\n");
+    }
+    if (gen_trace(spec, seed, &hdr, &ops, err, sizeof(err)) < 0)
+        app_error("%s\n", err);
+
+    if (gen_file[0] != '\0')
+        remove_gen_file();
+    else
+        atexit(remove_gen_file);
+    strcpy(gen_file, "/tmp/mdriver-gen-XXXXXX");
+    if ((fd = mkstemp(gen_file)) < 0 || (out = fdopen(fd, "w")) == NULL)
+        unix_error("Could not create a file for the -g trace");
+    if (btrace_write(out, &hdr, ops, 0) < 0 || fclose(out) != 0)
+        unix_error("Could not write %s", gen_file);
+    free(ops);
+
+    if (verbose > 0)
+        printf("Generated %d requests, %d ids from %s\n",
+               hdr.num_ops, hdr.max_id + 1, spec);
+}
+
+static void remove_gen_file(void)
+{
+    if (gen_file[0] != '\0')
+        unlink(gen_file);
 }
 
 /*
@@ -824,15 +1631,19 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);
+    if (trace->map != NULL)   /* unmap or free the requests... */
+        munmap(trace->map, trace->map_len);
+    else
+        free(trace->ops);
+    free(trace->blocks);      /* ...and the three arrays */
     free(trace->block_sizes);
     free(trace->block_rand_base);
+    free(trace->arena_ids);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -846,12 +1657,13 @@ static void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-    int i;
+    int i, j;
     int index;
     size_t size;
     char *newp;
     char *oldp;
     char *p;
+    mm_arena_t *region = NULL;
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -870,17 +1682,11 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         size = trace->ops[i].size;
 
         if(debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
-                        
             /* Let the students check their own heap */
             mm_checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
-            r = *ranges;
-            while(r) {
-                check_index(trace, i, r->index);
-                r = r->next;
-            }
+            check_ranges(trace, i, *ranges);
         }
 
         switch (trace->ops[i].type) {
@@ -909,6 +1715,21 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             randomize_block(trace, index);
             break;
 
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_calloc(1, size)) == NULL) {
+                malloc_error(trace, i, "mm_calloc failed.");
+                return 0;
+            }
+            if (add_range(ranges, p, size, trace, i, index) == 0)
+                return 0;
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+
+            /* It must come back zeroed, whatever the block held before */
+            check_zero(trace, i, index);
+            randomize_block(trace, index);
+            break;
+
         case REALLOC: /* mm_realloc */
             check_index(trace, i, index);
 
@@ -962,110 +1783,278 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             mm_free(p);
             break;
 
+        case ARENA_BEGIN: /* mm_arena_create */
+            if (arena_flag && (region = mm_arena_create()) == NULL) {
+                malloc_error(trace, i, "mm_arena_create failed.");
+                return 0;
+            }
+            break;
+
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            p = region != NULL ? mm_arena_alloc(region, size) :
+                mm_malloc(size);
+            if (p == NULL) {
+                malloc_error(trace, i, "mm_arena_alloc failed.");
+                return 0;
+            }
+            if (add_range(ranges, p, size, trace, i, index) == 0)
+                return 0;
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            randomize_block(trace, index);
+            break;
+
+        case ARENA_FREE: /* a no-op in a region */
+            check_index(trace, i, index);
+            remove_range(ranges, trace->blocks[index]);
+            if (region == NULL)
+                mm_free(trace->blocks[index]);
+            trace->blocks[index] = NULL;
+            break;
+
+        case ARENA_END: /* mm_arena_destroy */
+            /* the blocks it still holds have to survive up to here */
+            for (j = 0; j < (int)size; j++) {
+                p = trace->blocks[trace->arena_ids[index + j]];
+                check_index(trace, i, trace->arena_ids[index + j]);
+                remove_range(ranges, p);
+                if (region == NULL)
+                    mm_free(p);
+                trace->blocks[trace->arena_ids[index + j]] = NULL;
+            }
+            if (region != NULL)
+                mm_arena_destroy(region);
+            region = NULL;
+            break;
+
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
 
     }
 
+    /* Sizes near SIZE_MAX wrap when rounded to a block, they must fail */
+    if ((p = mm_calloc(1, SIZE_MAX - 8)) != NULL) {
+        malloc_error(trace, i, "mm_calloc of SIZE_MAX - 8 bytes returned "
+                     "%p, not NULL.", p);
+        return 0;
+    }
+    if ((oldp = mm_malloc(16)) == NULL) {
+        malloc_error(trace, i, "mm_malloc failed.");
+        return 0;
+    }
+    if ((p = mm_realloc(oldp, SIZE_MAX - 8)) != NULL) {
+        malloc_error(trace, i, "mm_realloc to SIZE_MAX - 8 bytes returned "
+                     "%p, not NULL.", p);
+        return 0;
+    }
+    mm_free(oldp);
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
 
+/*
+ * replay_start - Set r up to replay the trace on a fresh heap with
+ *    replay_op, in the given REPLAY_ mode. caller is the eval_ routine
+ *    the error messages name.
+ */
+static void replay_start(replay_t *r, trace_t *trace, int tracenum,
+                         const char *caller, int mode)
+{
+    memset(r, 0, sizeof(*r));
+    r->trace = trace;
+    r->tracenum = tracenum;
+    r->caller = caller;
+    r->mode = mode;
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    /* start from nothing resident, as a fresh process would */
+    if (mode & REPLAY_TOUCH)
+        madvise(mem_heap_lo(), MAX_HEAP, MADV_DONTNEED);
+    if (mm_init() < 0)
+        app_error("trace %d: mm_init failed in %s", tracenum, caller);
+}
+
+/*
+ * replay_clock - the counter if r is timed, else 0
+ */
+static inline unsigned long long replay_clock(const replay_t *r)
+{
+    return (r->mode & REPLAY_TIMED) ? read_counter() : 0;
+}
+
+/*
+ * replay_op - Replay request i of r's trace on mm, and keep the block
+ *    sizes and the live payload up to date. A freed block's size drops
+ *    to 0. Without regions (-N) their requests are plain mallocs and
+ *    frees.
+ */
+static void replay_op(replay_t *r, int i)
+{
+    trace_t *trace = r->trace;
+    int index = trace->ops[i].index;
+    size_t size = trace->ops[i].size;
+    size_t old;
+    char *p;
+    int j;
+
+    r->op = -1;
+    r->size = size;
+    switch (trace->ops[i].type) {
+
+    case ALLOC: /* mm_malloc */
+        r->op = LAT_MALLOC;
+        r->t0 = replay_clock(r);
+        p = mm_malloc(size);
+        r->t1 = replay_clock(r);
+        if (p == NULL)
+            app_error("trace %d: mm_malloc failed in %s",
+                      r->tracenum, r->caller);
+        /* touch the payload, as a program would */
+        if (r->mode & REPLAY_TOUCH)
+            memset(p, 0, size);
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        r->live += size;
+        break;
+
+    case CALLOC: /* mm_calloc, which touches what it has to clear */
+        r->op = LAT_CALLOC;
+        r->t0 = replay_clock(r);
+        p = mm_calloc(1, size);
+        r->t1 = replay_clock(r);
+        if (p == NULL)
+            app_error("trace %d: mm_calloc failed in %s",
+                      r->tracenum, r->caller);
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        r->live += size;
+        break;
+
+    case REALLOC: /* mm_realloc */
+        old = trace->block_sizes[index];
+        r->op = LAT_REALLOC;
+        r->t0 = replay_clock(r);
+        p = mm_realloc(trace->blocks[index], size);
+        r->t1 = replay_clock(r);
+        if (p == NULL && size != 0)
+            app_error("trace %d: mm_realloc failed in %s",
+                      r->tracenum, r->caller);
+        if ((r->mode & REPLAY_TOUCH) && size > old)
+            memset(p + old, 0, size - old);
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        r->live += size - old;
+        break;
+
+    case FREE: /* mm_free */
+        p = index < 0 ? NULL : trace->blocks[index];
+        r->size = index < 0 ? 0 : trace->block_sizes[index];
+        r->op = LAT_FREE;
+        r->t0 = replay_clock(r);
+        mm_free(p);
+        r->t1 = replay_clock(r);
+        if (index >= 0)
+            trace->block_sizes[index] = 0;
+        r->live -= r->size;
+        break;
+
+    case ARENA_BEGIN: /* mm_arena_create */
+        if (!arena_flag)
+            break;
+        r->op = LAT_ARENA_CREATE;
+        r->t0 = replay_clock(r);
+        r->region = mm_arena_create();
+        r->t1 = replay_clock(r);
+        if (r->region == NULL)
+            app_error("trace %d: mm_arena_create failed in %s",
+                      r->tracenum, r->caller);
+        break;
+
+    case ARENA_ALLOC: /* mm_arena_alloc */
+        r->op = LAT_ARENA_ALLOC;
+        r->t0 = replay_clock(r);
+        p = r->region != NULL ? mm_arena_alloc(r->region, size) :
+            mm_malloc(size);
+        r->t1 = replay_clock(r);
+        if (p == NULL)
+            app_error("trace %d: mm_arena_alloc failed in %s",
+                      r->tracenum, r->caller);
+        if (r->mode & REPLAY_TOUCH)
+            memset(p, 0, size);
+        trace->blocks[index] = p;
+        trace->block_sizes[index] = size;
+        r->live += size;
+        break;
+
+    case ARENA_FREE: /* a no-op in a region, else a free */
+        r->size = trace->block_sizes[index];
+        if (r->region == NULL) {
+            r->op = LAT_FREE;
+            r->t0 = replay_clock(r);
+            mm_free(trace->blocks[index]);
+            r->t1 = replay_clock(r);
+        }
+        trace->block_sizes[index] = 0;
+        r->live -= r->size;
+        break;
+
+    case ARENA_END: /* mm_arena_destroy, of what its blocks still hold */
+        r->size = 0;
+        for (j = 0; j < (int)size; j++)
+            r->size += trace->block_sizes[trace->arena_ids[index + j]];
+        r->op = LAT_ARENA_DESTROY;
+        r->t0 = replay_clock(r);
+        if (r->region != NULL)
+            mm_arena_destroy(r->region);
+        else
+            for (j = 0; j < (int)size; j++)
+                mm_free(trace->blocks[trace->arena_ids[index + j]]);
+        r->t1 = replay_clock(r);
+        for (j = 0; j < (int)size; j++)
+            trace->block_sizes[trace->arena_ids[index + j]] = 0;
+        r->region = NULL;
+        r->live -= r->size;
+        break;
+
+    default:
+        app_error("trace %d: Nonexistent request type in %s",
+                  r->tracenum, r->caller);
+    }
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap plus the package's mem_mmap() mappings in
+ *   bytes while running the student's malloc package on the trace.
+ *   mem_sbrk() lets the package shrink the heap, so this is its high
+ *   water mark, not its final size.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
     int i;
-    int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
-    char *p;
-    char *newp, *oldp;
-
-    reinit_trace(trace);
-
-    /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (mm_init() < 0)
-        app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
+    size_t max_total_size = 0;
+    replay_t r;
 
+    replay_start(&r, trace, tracenum, "eval_mm_util", 0);
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-
-        case ALLOC: /* mm_alloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-
-            if ((p = mm_malloc(size)) == NULL) {
-                app_error("trace %d: mm_malloc failed in eval_mm_util",
-                          tracenum);
-            }
-
-            /* Remember region and size */
-            trace->blocks[index] = p;
-            trace->block_sizes[index] = size;
-
-            total_size += size;
-            break;
-
-        case REALLOC: /* mm_realloc */
-            index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-            oldsize = trace->block_sizes[index];
-
-            oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
-                app_error("trace %d: mm_realloc failed in eval_mm_util",
-                          tracenum);
-            }
-
-            /* Remember region and size */
-            trace->blocks[index] = newp;
-            trace->block_sizes[index] = newsize;
-
-            total_size += (newsize - oldsize);
-            break;
-
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            if(index < 0) {
-                size = 0;
-                p = 0;
-            } else {
-                size = trace->block_sizes[index];
-                p = trace->blocks[index];
-            }
-
-            mm_free(p);
-
-            total_size -= size;
-            break;
-
-        default:
-            app_error("trace %d: Nonexistent request type in eval_mm_util",
-                      tracenum);
-        }
+        replay_op(&r, i);
 
         /* update the high-water mark */
-        max_total_size = (total_size > max_total_size) ?
-            total_size : max_total_size;
+        max_total_size = (r.live > max_total_size) ?
+            r.live : max_total_size;
     }
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -1075,9 +2064,10 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, j, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    mm_arena_t *region = NULL;
     reinit_trace(trace);
 
     /* Reset the heap and initialize the mm package */
@@ -1097,6 +2087,14 @@ static void eval_mm_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1116,11 +2114,688 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case ARENA_BEGIN: /* mm_arena_create */
+            if (arena_flag && (region = mm_arena_create()) == NULL)
+                app_error("mm_arena_create error in eval_mm_speed");
+            break;
+
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            p = region != NULL ? mm_arena_alloc(region, size) :
+                mm_malloc(size);
+            if (p == NULL)
+                app_error("mm_arena_alloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case ARENA_FREE: /* a no-op in a region */
+            if (region == NULL)
+                mm_free(trace->blocks[trace->ops[i].index]);
+            break;
+
+        case ARENA_END: /* mm_arena_destroy */
+            if (region != NULL) {
+                mm_arena_destroy(region);
+                region = NULL;
+                break;
+            }
+            index = trace->ops[i].index;
+            for (j = 0; j < (int)trace->ops[i].size; j++)
+                mm_free(trace->blocks[trace->arena_ids[index + j]]);
+            break;
+
         default:
             app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
+/*
+ * xfree_send - queue a free for the thread's peer, handing the batch
+ *    over once it is full. A NULL p hands over what is queued.
+ */
+static void xfree_send(thread_t *t, char *p)
+{
+    inbox_t *in = &t->peer->inbox;
+
+    if (p != NULL) {
+        t->out[t->num_out++] = p;
+        if (t->num_out < XFREE_BATCH)
+            return;
+    }
+
+    pthread_mutex_lock(&in->lock);
+    if (in->n + t->num_out > in->cap) {
+        in->cap = 2 * (in->n + t->num_out);
+        if ((in->items = realloc(in->items, in->cap * sizeof(char *))) == NULL)
+            unix_error("realloc failed in xfree_send");
+    }
+    memcpy(in->items + in->n, t->out, t->num_out * sizeof(char *));
+    in->n += t->num_out;
+    pthread_mutex_unlock(&in->lock);
+    t->num_out = 0;
+}
+
+/*
+ * xfree_drain - free the blocks other threads sent this thread
+ */
+static void xfree_drain(thread_t *t)
+{
+    inbox_t *in = &t->inbox;
+    char **items;
+    int i, n, cap;
+
+    if (__atomic_load_n(&in->n, __ATOMIC_RELAXED) == 0)
+        return;
+    pthread_mutex_lock(&in->lock);
+    items = in->items;
+    cap = in->cap;
+    n = in->n;
+    in->items = t->spare;
+    in->cap = t->spare_cap;
+    in->n = 0;
+    pthread_mutex_unlock(&in->lock);
+
+    for (i = 0; i < n; i++)
+        t->a->free(items[i]);
+    t->spare = items;
+    t->spare_cap = cap;
+}
+
+/*
+ * xfree_pick - whether the free of request i goes to the peer, every
+ *    thread picks the same xfree_pct percent of its requests
+ */
+static inline int xfree_pick(int i)
+{
+    return (unsigned)i * 2654435761u % 100 < (unsigned)xfree_pct;
+}
+
+/*
+ * eval_thread - Body of one -T mode thread: replay its requests into
+ *    its private block array once all threads are ready. With -X some
+ *    frees are sent to the peer instead, and the thread frees what the
+ *    others sent it, at the end once they have all finished. Inlined
+ *    into one thread function per allocator, so its calls are direct.
+ */
+static inline __attribute__((always_inline))
+void eval_thread(thread_t *t, const allocator_t *a)
+{
+    traceop_t *ops = t->ops;
+    int i, j, index;
+    size_t size;
+    char *p;
+    mm_arena_t *region = NULL;
+
+    pthread_barrier_wait(t->start);
+    clock_gettime(CLOCK_MONOTONIC, &t->t0);
+
+    for (i = 0;  i < t->num_ops;  i++) {
+        index = ops[i].index;
+        size = ops[i].size;
+
+        if (t->peer != NULL && (i & XFREE_POLL) == 0)
+            xfree_drain(t);
+
+        switch (ops[i].type) {
+
+        case ALLOC: /* malloc */
+            if ((p = a->malloc(size)) == NULL) {
+                t->failed = 1;
+                goto out;
+            }
+            t->blocks[index] = p;
+            break;
+
+        case CALLOC: /* calloc */
+            if ((p = a->calloc(1, size)) == NULL) {
+                t->failed = 1;
+                goto out;
+            }
+            t->blocks[index] = p;
+            break;
+
+        case REALLOC: /* realloc */
+            if ((p = a->realloc(t->blocks[index], size)) == NULL && size != 0) {
+                t->failed = 1;
+                goto out;
+            }
+            t->blocks[index] = p;
+            break;
+
+        case FREE: /* free */
+            p = index < 0 ? NULL : t->blocks[index];
+            if (p != NULL && t->peer != NULL && xfree_pick(i))
+                xfree_send(t, p);
+            else
+                a->free(p);
+            break;
+
+        case ARENA_BEGIN: /* mm_arena_create */
+            if (a->arena_create != NULL && arena_flag &&
+                (region = a->arena_create()) == NULL) {
+                t->failed = 1;
+                goto out;
+            }
+            break;
+
+        case ARENA_ALLOC: /* mm_arena_alloc */
+            p = region != NULL ? a->arena_alloc(region, size) :
+                a->malloc(size);
+            if (p == NULL) {
+                t->failed = 1;
+                goto out;
+            }
+            t->blocks[index] = p;
+            break;
+
+        case ARENA_FREE: /* a no-op in a region */
+            if (region == NULL)
+                a->free(t->blocks[index]);
+            t->blocks[index] = NULL;
+            break;
+
+        case ARENA_END: /* mm_arena_destroy */
+            if (region != NULL) {
+                a->arena_destroy(region);
+                region = NULL;
+                break;
+            }
+            /* with -P the blocks of the other threads' ids are NULL */
+            for (j = 0; j < (int)size; j++)
+                a->free(t->blocks[t->arena_ids[index + j]]);
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_thread");
+        }
+    }
+
+ out:
+    /* hand over the last batch, then wait for everyone else's */
+    if (t->peer != NULL) {
+        xfree_send(t, NULL);
+        pthread_barrier_wait(t->done);
+        xfree_drain(t);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t->t1);
+}
+
+static void *eval_mm_thread(void *ptr)
+{
+    eval_thread(ptr, &mm_allocator);
+    return NULL;
+}
+
+static void *eval_libc_thread(void *ptr)
+{
+    eval_thread(ptr, &libc_allocator);
+    return NULL;
+}
+
+/* Seconds from a to b */
+static double timespec_diff(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + 1e-9 * (b->tv_nsec - a->tv_nsec);
+}
+
+/* Fresh heaps for a -T mode run */
+static int mm_reset(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+
+static int libc_reset(void)
+{
+    return 0;
+}
+
+/*
+ * split_trace - Give thread k of n the requests on the block ids that
+ *    are k modulo n, so each block's requests stay in order on one
+ *    thread. free(NULL) goes to thread 0, and the region requests to
+ *    all of them.
+ */
+static void split_trace(trace_t *trace, thread_t *args, int n)
+{
+    int i, k;
+
+    for (k = 0; k < n; k++) {
+        args[k].num_ops = 0;
+        if ((args[k].ops = malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+            unix_error("malloc failed in split_trace");
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+        if (trace->ops[i].type == ARENA_BEGIN ||
+            trace->ops[i].type == ARENA_END) {
+            /* every thread opens the region for its own ids */
+            for (k = 0; k < n; k++)
+                args[k].ops[args[k].num_ops++] = trace->ops[i];
+            continue;
+        }
+        k = trace->ops[i].index < 0 ? 0 : trace->ops[i].index % n;
+        args[k].ops[args[k].num_ops++] = trace->ops[i];
+    }
+}
+
+/*
+ * eval_speed_mt - Replay the trace from nthreads threads at once, each
+ *    on its own copy of the block array, so each thread gets its own
+ *    arena. Each thread replays the whole trace, or with -P its share
+ *    of the blocks. A run lasts from the first thread's start to the
+ *    last thread's finish. Returns the best wall clock time of MT_RUNS
+ *    runs, or -1 if the heap ran out.
+ */
+static double eval_speed_mt(trace_t *trace, int nthreads,
+                            const allocator_t *a)
+{
+    pthread_t *tids;
+    thread_t *args;
+    pthread_barrier_t start, done;
+    struct timespec *t0, *t1;
+    double secs, best = -1;
+    int i, run, failed = 0;
+
+    if ((tids = calloc(nthreads, sizeof(*tids))) == NULL ||
+        (args = calloc(nthreads, sizeof(*args))) == NULL)
+        unix_error("calloc failed in eval_speed_mt");
+    for (i = 0; i < nthreads; i++) {
+        args[i].a = a;
+        args[i].ops = trace->ops;
+        args[i].num_ops = trace->num_ops;
+        args[i].arena_ids = trace->arena_ids;
+        args[i].start = &start;
+        args[i].done = &done;
+        if (nthreads > 1 && xfree_pct > 0)
+            args[i].peer = &args[(i + 1) % nthreads];
+        pthread_mutex_init(&args[i].inbox.lock, NULL);
+        if ((args[i].blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+            unix_error("calloc failed in eval_speed_mt");
+    }
+    if (split_flag)
+        split_trace(trace, args, nthreads);
+
+    for (run = 0; run < MT_RUNS && !failed; run++) {
+        if (a->init() < 0)
+            app_error("init failed in eval_speed_mt");
+
+        pthread_barrier_init(&start, NULL, nthreads + 1);
+        pthread_barrier_init(&done, NULL, nthreads);
+        for (i = 0; i < nthreads; i++) {
+            memset(args[i].blocks, 0, trace->num_ids * sizeof(char *));
+            args[i].failed = 0;
+            if (pthread_create(&tids[i], NULL, a == &mm_allocator ?
+                               eval_mm_thread : eval_libc_thread,
+                               &args[i]) != 0)
+                app_error("pthread_create failed in eval_speed_mt");
+        }
+
+        pthread_barrier_wait(&start);
+        for (i = 0; i < nthreads; i++) {
+            pthread_join(tids[i], NULL);
+            failed |= args[i].failed;
+        }
+        pthread_barrier_destroy(&start);
+        pthread_barrier_destroy(&done);
+        if (failed)
+            break;
+
+        t0 = &args[0].t0;
+        t1 = &args[0].t1;
+        for (i = 1; i < nthreads; i++) {
+            if (timespec_diff(&args[i].t0, t0) > 0)
+                t0 = &args[i].t0;
+            if (timespec_diff(t1, &args[i].t1) > 0)
+                t1 = &args[i].t1;
+        }
+        secs = timespec_diff(t0, t1);
+        if (best < 0 || secs < best)
+            best = secs;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (split_flag)
+            free(args[i].ops);
+        free(args[i].blocks);
+        free(args[i].inbox.items);
+        free(args[i].spare);
+        pthread_mutex_destroy(&args[i].inbox.lock);
+    }
+    free(args);
+    free(tids);
+
+    return failed ? -1 : best;
+}
+
+/*
+ * eval_sweep - Time the -T mode replay of mm and libc malloc with 1 to
+ *    sweep_max threads
+ */
+static void eval_sweep(trace_t *trace, stats_t *stats)
+{
+    int k, n;
+
+    for (k = 0; k < 2; k++)
+        if ((stats->sweep[k] = calloc(sweep_max, sizeof(double))) == NULL)
+            unix_error("calloc failed in eval_sweep");
+    for (n = 1; n <= sweep_max; n++) {
+        stats->sweep[0][n - 1] = eval_speed_mt(trace, n, &mm_allocator);
+        stats->sweep[1][n - 1] = eval_speed_mt(trace, n, &libc_allocator);
+    }
+}
+
+/*
+ * eval_mm_rss - Replay the trace once more on a heap with no resident
+ *    pages, and sample the heap size and its resident bytes about
+ *    rss_samples times along the way, then once more after mm_trim(0).
+ */
+static void eval_mm_rss(trace_t *trace, int tracenum, stats_t *stats)
+{
+    int i, step;
+    rss_sample_t *s;
+    replay_t r;
+
+    step = (trace->num_ops + rss_samples - 1) / rss_samples;
+    if (step < 1)
+        step = 1;
+    if ((stats->rss = calloc(trace->num_ops / step + 3,
+                             sizeof(rss_sample_t))) == NULL)
+        unix_error("calloc failed in eval_mm_rss");
+    s = stats->rss;
+
+    replay_start(&r, trace, tracenum, "eval_mm_rss", REPLAY_TOUCH);
+    for (i = 0;  i < trace->num_ops;  i++) {
+        replay_op(&r, i);
+        if ((i + 1) % step == 0 || i + 1 == trace->num_ops) {
+            s->op = i + 1;
+            s->heap = mem_heapsize() + mem_mapped();
+            s->rss = mem_resident();
+            s++;
+        }
+    }
+
+    mm_trim(0);
+    s->op = -1;
+    s->heap = mem_heapsize() + mem_mapped();
+    s->rss = mem_resident();
+    s++;
+    stats->num_rss = s - stats->rss;
+}
+
+/*
+ * print_stats_header - the column names of the -H CSV file
+ */
+static void print_stats_header(void)
+{
+    int c;
+
+    fprintf(stats_file, "trace,op,live_bytes,heap_bytes,mapped_bytes,"
+            "alloc_blocks,mapped_blocks,free_blocks,free_bytes,largest_free,"
+            "ext_frag,overhead_bytes,splits,coalesces");
+    for (c = 0; c < MM_SIZE_CLASSES; c++)
+        fprintf(stats_file, ",free_blocks_%d", c);
+    for (c = 0; c < MM_SIZE_CLASSES; c++)
+        fprintf(stats_file, ",free_bytes_%d", c);
+    fprintf(stats_file, "\n");
+}
+
+/*
+ * eval_mm_stats - Replay the trace once more and write a row of
+ *    mm_stats to the -H file every stats_every requests and after the
+ *    last one. live_bytes is the payload the trace holds at that point,
+ *    over heap plus mapped bytes it gives the util over time.
+ */
+static void eval_mm_stats(trace_t *trace, int tracenum)
+{
+    mm_stats_t s;
+    int i, c;
+    replay_t r;
+
+    replay_start(&r, trace, tracenum, "eval_mm_stats", 0);
+    for (i = 0;  i < trace->num_ops;  i++) {
+        replay_op(&r, i);
+        if ((i + 1) % stats_every != 0 && i + 1 != trace->num_ops)
+            continue;
+        mm_stats(&s);
+        fprintf(stats_file, "%s,%d,%zu,%zu,%zu,%lu,%lu,%lu,%zu,%zu,%.4f,"
+                "%zu,%lu,%lu", trace->filename, i + 1, r.live, s.heap_bytes,
+                s.mapped_bytes, s.alloc_blocks, s.mapped_blocks,
+                s.total_free_blocks, s.total_free_bytes, s.largest_free,
+                s.ext_frag, s.overhead_bytes, s.splits, s.coalesces);
+        for (c = 0; c < MM_SIZE_CLASSES; c++)
+            fprintf(stats_file, ",%lu", s.free_blocks[c]);
+        for (c = 0; c < MM_SIZE_CLASSES; c++)
+            fprintf(stats_file, ",%zu", s.free_bytes[c]);
+        fprintf(stats_file, "\n");
+    }
+    fflush(stats_file);
+}
+
+/*
+ * eval_mm_profile - Replay the trace once to find its peak payload,
+ *    then again with mm's sampling profiler on and each request tagged
+ *    with its op index, so a site is a trace request and its tag
+ *    distance a lifetime in requests. The sites go to the -p file
+ *    twice: when the trace holds the most payload, where what is live
+ *    fragments the heap the most, and after the last request, with
+ *    what was left allocated.
+ */
+static void eval_mm_profile(trace_t *trace, int tracenum)
+{
+    size_t peak = 0;
+    int i, peak_op = 0;
+    replay_t r;
+
+    /* find the request after which the payload peaks */
+    replay_start(&r, trace, tracenum, "eval_mm_profile", 0);
+    for (i = 0;  i < trace->num_ops;  i++) {
+        replay_op(&r, i);
+        if (r.live > peak) {
+            peak = r.live;
+            peak_op = i;
+        }
+    }
+
+    replay_start(&r, trace, tracenum, "eval_mm_profile", 0);
+    mm_set_profile(prof_rate);
+    for (i = 0;  i < trace->num_ops;  i++) {
+        mm_profile_tag(i);
+        replay_op(&r, i);
+        if (i == peak_op) {
+            fprintf(prof_file, "--- %s after request %d of %d, "
+                    "at its peak payload of %zu bytes\n", trace->filename,
+                    i + 1, trace->num_ops, peak);
+            mm_profile_dump(prof_file, MM_PROF_TEXT);
+        }
+    }
+    mm_profile_tag(-1);
+
+    fprintf(prof_file, "--- %s after its last request\n", trace->filename);
+    mm_profile_dump(prof_file, MM_PROF_TEXT);
+    fflush(prof_file);
+    mm_set_profile(0);
+}
+
+/*
+ * lat_bucket - the histogram bucket of value v
+ */
+static inline int lat_bucket(unsigned long long v)
+{
+    int e;
+
+    if (v < LAT_SUB)
+        return v;
+    e = 63 - __builtin_clzll(v);
+    return (e - LAT_SUB_BITS + 1) * LAT_SUB +
+        (int)((v >> (e - LAT_SUB_BITS)) - LAT_SUB);
+}
+
+/*
+ * lat_bucket_high - the highest value that falls in bucket b
+ */
+static unsigned long long lat_bucket_high(int b)
+{
+    int e;
+
+    if (b < LAT_SUB)
+        return b;
+    e = b / LAT_SUB + LAT_SUB_BITS - 1;
+    return ((unsigned long long)(b % LAT_SUB + LAT_SUB + 1) <<
+            (e - LAT_SUB_BITS)) - 1;
+}
+
+/*
+ * lat_class - the size class of a request of size bytes
+ */
+static inline int lat_class(size_t size)
+{
+    int c = 0;
+
+    for (size_t limit = 64; c < LAT_CLASSES - 1 && size > limit; limit <<= 3)
+        c++;
+    return c;
+}
+
+/*
+ * lat_record - add one timed request, minus the timer's own cost
+ */
+static inline void lat_record(lat_hist_t *h, unsigned long long t0,
+                              unsigned long long t1)
+{
+    unsigned long long v = t1 - t0;
+
+    v = v > lat_overhead ? v - lat_overhead : 0;
+    h->count[lat_bucket(v)]++;
+    h->n++;
+    if (v > h->max)
+        h->max = v;
+}
+
+/*
+ * lat_summarize - percentiles of h, each reported as the highest value
+ *    of its bucket
+ */
+static void lat_summarize(const lat_hist_t *h, lat_summary_t *s)
+{
+    unsigned long seen = 0;
+    unsigned long need50 = (h->n * 50 + 99) / 100;
+    unsigned long need99 = (h->n * 99 + 99) / 100;
+    unsigned long need999 = (h->n * 999 + 999) / 1000;
+    int b, got50 = 0, got99 = 0;   /* bucket 0 is a latency too */
+
+    memset(s, 0, sizeof(*s));
+    s->n = h->n;
+    s->max = h->max;
+    if (h->n == 0)
+        return;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+        if (h->count[b] == 0)
+            continue;
+        seen += h->count[b];
+        if (!got50 && seen >= need50) {
+            s->p50 = lat_bucket_high(b);
+            got50 = 1;
+        }
+        if (!got99 && seen >= need99) {
+            s->p99 = lat_bucket_high(b);
+            got99 = 1;
+        }
+        if (seen >= need999) {
+            s->p999 = lat_bucket_high(b);
+            break;
+        }
+    }
+    /* the top bucket may reach past the largest value seen */
+    s->p50 = s->p50 < s->max ? s->p50 : s->max;
+    s->p99 = s->p99 < s->max ? s->p99 : s->max;
+    s->p999 = s->p999 < s->max ? s->p999 : s->max;
+}
+
+/*
+ * calibrate_latency - the cost of timing an empty request, the lowest
+ *    of many back to back counter reads. Subtracting the lowest rather
+ *    than a typical cost never takes away time the allocator spent.
+ */
+static unsigned long long calibrate_latency(void)
+{
+    unsigned long long t0, t1, best = ~0ULL;
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        t0 = read_counter();
+        t1 = read_counter();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
+
+/*
+ * eval_mm_pages - The trace was just timed on huge pages (-U). Note how
+ *    much of the heap they back, then time it again on a heap in base
+ *    pages and go back to huge pages for the runs that follow.
+ */
+static void eval_mm_pages(speed_t *speed_params, stats_t *stats)
+{
+    stats->pages = mem_pages();
+    stats->huge_bytes = mem_heap_huge();
+
+    mem_deinit();
+    mem_set_pages(MEM_PAGES_SMALL);
+    mem_init();
+    stats->small_secs = fsecs(eval_mm_speed, speed_params);
+    fsecs_counts(&stats->small_perf);
+
+    mem_deinit();
+    mem_set_pages(huge_pages);
+    mem_init();
+}
+
+/*
+ * eval_mm_latency - Replay the trace with every request timed, enough
+ *    times for LAT_MIN_SAMPLES requests (at most LAT_MAX_RUNS), and keep
+ *    the percentiles per op type and size class. A free is classed by
+ *    the size of the block it frees, and a region's end by what its
+ *    blocks still hold. With -N that end is the frees of those blocks.
+ */
+static void eval_mm_latency(trace_t *trace, int tracenum, stats_t *stats)
+{
+    lat_hist_t *hist, all;
+    int i, run, runs, op, c;
+    replay_t r;
+
+    if ((hist = calloc(LAT_OPS * LAT_CLASSES, sizeof(lat_hist_t))) == NULL)
+        unix_error("calloc failed in eval_mm_latency");
+
+    runs = trace->num_ops > 0 ? LAT_MIN_SAMPLES / trace->num_ops : 1;
+    runs = runs < 1 ? 1 : (runs > LAT_MAX_RUNS ? LAT_MAX_RUNS : runs);
+    for (run = 0; run < runs; run++) {
+        replay_start(&r, trace, tracenum, "eval_mm_latency", REPLAY_TIMED);
+        for (i = 0;  i < trace->num_ops;  i++) {
+            replay_op(&r, i);
+            if (r.op >= 0)
+                lat_record(&hist[r.op * LAT_CLASSES + lat_class(r.size)],
+                           r.t0, r.t1);
+        }
+    }
+
+    for (op = 0; op < LAT_OPS; op++) {
+        memset(&all, 0, sizeof(all));
+        for (c = 0; c < LAT_CLASSES; c++) {
+            lat_hist_t *h = &hist[op * LAT_CLASSES + c];
+
+            lat_summarize(h, &stats->lat[op][c]);
+            for (i = 0; i < LAT_BUCKETS; i++)
+                all.count[i] += h->count[i];
+            all.n += h->n;
+            all.max = h->max > all.max ? h->max : all.max;
+        }
+        lat_summarize(&all, &stats->lat[op][LAT_CLASSES]);
+    }
+    free(hist);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1129,7 +2804,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     reinit_trace(trace);
@@ -1138,6 +2813,7 @@ static int eval_libc_valid(trace_t *trace)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
+        case ARENA_ALLOC: /* libc has no regions */
             if ((p = malloc(trace->ops[i].size)) == NULL) {
                 malloc_error(trace, i, "libc malloc failed");
                 unix_error("System message");
@@ -1145,6 +2821,14 @@ static int eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+                malloc_error(trace, i, "libc calloc failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1156,6 +2840,7 @@ static int eval_libc_valid(trace_t *trace)
             break;
 
         case FREE: /* free */
+        case ARENA_FREE:
             if(trace->ops[i].index >= 0) {
                 free(trace->blocks[trace->ops[i].index]);
             } else {
@@ -1163,6 +2848,14 @@ static int eval_libc_valid(trace_t *trace)
             }
             break;
 
+        case ARENA_BEGIN:
+            break;
+
+        case ARENA_END: /* free what the region still holds */
+            for (j = 0; j < (int)trace->ops[i].size; j++)
+                free(trace->blocks[trace->arena_ids[trace->ops[i].index + j]]);
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1178,7 +2871,7 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -1188,6 +2881,7 @@ static void eval_libc_speed(void *ptr)
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
+        case ARENA_ALLOC: /* libc has no regions */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
             if ((p = malloc(size)) == NULL)
@@ -1195,6 +2889,14 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = calloc(1, size)) == NULL)
+                unix_error("calloc failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1206,6 +2908,7 @@ static void eval_libc_speed(void *ptr)
             break;
 
         case FREE: /* free */
+        case ARENA_FREE:
             index = trace->ops[i].index;
             if(index >= 0) {
                 block = trace->blocks[index];
@@ -1214,6 +2917,15 @@ static void eval_libc_speed(void *ptr)
                 free(0);
             }
             break;
+
+        case ARENA_BEGIN:
+            break;
+
+        case ARENA_END: /* free what the region still holds */
+            index = trace->ops[i].index;
+            for (j = 0; j < (int)trace->ops[i].size; j++)
+                free(trace->blocks[trace->arena_ids[index + j]]);
+            break;
         }
     }
 }
@@ -1228,19 +2940,25 @@ static void eval_libc_speed(void *ptr)
  */
 static void printresults(int n, stats_t *stats)
 {
-    int i;
+    int i, e;
     /* weighted sums all */
     double sumsecs = 0;
     double sumops  = 0;
     double sumutil = 0;
+    double sumperf[PERF_EVENTS] = {0};  /* < 0 once a trace lacks one */
     int sum_perf_weight = 0;
     int sum_util_weight = 0;
+    int counting = perf_available();
 
     char wstr;
 
-    /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    /* Print the individual results for each trace, with the hardware
+       events per request next to Kops if there are any */
+    printf("  %2s%6s %5s%8s%9s",
+           "valid", "util", "ops", "secs", "Kops");
+    for (e = 0; counting && e < PERF_EVENTS; e++)
+        printf(" %8s", perf_event_names[e]);
+    printf("  %s\n", "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1282,6 +3000,13 @@ static void printresults(int n, stats_t *stats)
             else
                 printf("%8s%10s%6s", "--", "--", "--");
 
+            for (e = 0; counting && e < PERF_EVENTS; e++) {
+                if (stats[i].perf.count[e] >= 0)
+                    printf(" %8.2f", stats[i].perf.count[e] / stats[i].ops);
+                else
+                    printf(" %8s", "-");
+            }
+
             printf(" %s\n", stats[i].filename);
 
             if(stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1289,6 +3014,12 @@ static void printresults(int n, stats_t *stats)
                     sum_perf_weight += 1;
                     sumsecs += stats[i].secs;
                     sumops += stats[i].ops;
+                    for (e = 0; e < PERF_EVENTS; e++) {
+                        if (stats[i].perf.count[e] < 0 || sumperf[e] < 0)
+                            sumperf[e] = -1;
+                        else
+                            sumperf[e] += stats[i].perf.count[e];
+                    }
                 }
             if(stats[i].weight == WALL || stats[i].weight == WUTIL)
                 {
@@ -1313,13 +3044,20 @@ static void printresults(int n, stats_t *stats)
         if(sum_perf_weight == 0) sum_perf_weight = 1;
         if(sum_util_weight == 0) sum_util_weight = 1;
 
-        printf("%2d %2d  %5.0f%%%8.0f%10.6f%6.0f\n",
+        printf("%2d %2d  %5.0f%%%8.0f%10.6f%6.0f",
                sum_util_weight,
                sum_perf_weight,
                (sumutil/(double)sum_util_weight)*100.0,
                sumops,
                sumsecs,
                (sumsecs==0.0) ? 0 : (sumops/1e3)/sumsecs);
+        for (e = 0; counting && e < PERF_EVENTS; e++) {
+            if (sumperf[e] >= 0 && sumops > 0)
+                printf(" %8.2f", sumperf[e] / sumops);
+            else
+                printf(" %8s", "-");
+        }
+        printf("\n");
     }
     else {
         printf("     %8s%10s%6s\n",
@@ -1330,6 +3068,255 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printresults_mt - prints the -T results of the mm package: the ops and
+ *    throughput of all threads together, and the speedup over the
+ *    single threaded run of the same trace
+ */
+static void printresults_mt(int n, stats_t *stats)
+{
+    int i;
+    double ops, kops;
+
+    printf("  %9s%10s%8s%7s  %s\n", "ops", "secs", "Kops", "scale", "trace");
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid || stats[i].mt_secs < 0) {
+            printf("  %9s%10s%8s%7s  %s\n", "-", "-", "-", "-",
+                   stats[i].filename);
+            continue;
+        }
+        ops = split_flag ? stats[i].ops : stats[i].ops * num_threads;
+        kops = (ops/1e3)/stats[i].mt_secs;
+        printf("  %9.0f%10.6f%8.0f%6.2fx  %s\n", ops, stats[i].mt_secs, kops,
+               kops / ((stats[i].ops/1e3)/stats[i].secs), stats[i].filename);
+    }
+}
+
+/*
+ * printresults_sweep - prints the -W results: the throughput of all
+ *    threads together for each thread count, and the scaling
+ *    efficiency, that throughput over n times the one thread throughput
+ */
+static void printresults_sweep(int n, stats_t *stats)
+{
+    int i, k, t;
+    double ops, kops[2], base[2];
+
+    printf("  %7s%10s%6s%10s%6s  %s\n", "threads", "mm Kops", "eff",
+           "libc Kops", "eff", "trace");
+    for (i=0; i < n; i++) {
+        if (!stats[i].valid) {
+            printf("  %7s%10s%6s%10s%6s  %s\n", "-", "-", "-", "-", "-",
+                   stats[i].filename);
+            continue;
+        }
+        for (t = 1; t <= sweep_max; t++) {
+            ops = split_flag ? stats[i].ops : stats[i].ops * t;
+            printf("  %7d", t);
+            for (k = 0; k < 2; k++) {
+                if (stats[i].sweep[k][t - 1] <= 0 ||
+                    stats[i].sweep[k][0] <= 0) {
+                    printf("%10s%6s", "-", "-");
+                    continue;
+                }
+                kops[k] = (ops/1e3)/stats[i].sweep[k][t - 1];
+                if (t == 1)
+                    base[k] = kops[k];
+                printf("%10.0f%5.0f%%", kops[k], 100 * kops[k] / (t * base[k]));
+            }
+            printf("  %s\n", stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printresults_tcache - prints the thread cache counters of the mm
+ *    package, counted during the util run of each trace
+ */
+static void printresults_tcache(int n, stats_t *stats)
+{
+    int i;
+    mm_tcache_stats_t *tc;
+    unsigned long lookups;
+
+    printf("  %8s%8s%6s%8s%8s%8s  %s\n", "hits", "misses", "hit%",
+           "kept", "flushed", "refill", "trace");
+    for (i=0; i < n; i++) {
+        tc = &stats[i].tcache;
+        lookups = tc->malloc_hits + tc->malloc_misses;
+        if (!stats[i].valid) {
+            printf("  %8s%8s%6s%8s%8s%8s  %s\n", "-", "-", "-", "-", "-", "-",
+                   stats[i].filename);
+            continue;
+        }
+        printf("  %8lu%8lu%5.0f%%%8lu%8lu%8lu  %s\n", tc->malloc_hits,
+               tc->malloc_misses,
+               lookups ? 100.0 * tc->malloc_hits / lookups : 0.0,
+               tc->free_hits, tc->flushed, tc->refilled, stats[i].filename);
+    }
+}
+
+/*
+ * printresults_realloc - prints the realloc counters of the mm package,
+ *    counted during the util run of each trace
+ */
+static void printresults_realloc(int n, stats_t *stats)
+{
+    int i;
+    mm_realloc_stats_t *rs;
+
+    printf("  %8s%8s%8s%8s%12s%8s  %s\n", "shrunk", "grown", "extend",
+           "moved", "copied", "remap", "trace");
+    for (i=0; i < n; i++) {
+        rs = &stats[i].realloc;
+        if (!stats[i].valid) {
+            printf("  %8s%8s%8s%8s%12s%8s  %s\n", "-", "-", "-", "-", "-",
+                   "-", stats[i].filename);
+            continue;
+        }
+        printf("  %8lu%8lu%8lu%8lu%12lu%8lu  %s\n", rs->shrunk, rs->grown,
+               rs->extended, rs->moved, rs->bytes_copied, rs->remapped,
+               stats[i].filename);
+    }
+}
+
+/*
+ * printresults_sbrk - prints the mem_sbrk calls that grew the heap and
+ *    the peak footprint of each trace's util run, next to its util
+ */
+static void printresults_sbrk(int n, stats_t *stats)
+{
+    int i;
+    unsigned long sbrks = 0;
+
+    printf("  %8s%12s%6s  %s\n", "sbrks", "peak", "util", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid) {
+            printf("  %8s%12s%6s  %s\n", "-", "-", "-", stats[i].filename);
+            continue;
+        }
+        printf("  %8lu%12zu%5.0f%%  %s\n", stats[i].sbrks, stats[i].peak,
+               stats[i].util * 100.0, stats[i].filename);
+        sbrks += stats[i].sbrks;
+    }
+    printf("  %8lu%12s%6s  %s\n", sbrks, "", "", "total");
+}
+
+/*
+ * printresults_pages - prints the Kops and dTLB misses per request of
+ *    each trace on base pages and on huge pages (-U), and how much of
+ *    the heap huge pages backed
+ */
+static void printresults_pages(int n, stats_t *stats)
+{
+    static const char *page_names[] = { "4K", "thp", "hugetlb" };
+    int i;
+
+    printf("  %8s%9s%9s%9s%10s%10s%10s  %s\n", "pages", "hugeKB",
+           "Kops-4K", "Kops-hp", "dTLB-4K", "dTLB-hp", "delta", "trace");
+    for (i = 0; i < n; i++) {
+        double small = stats[i].small_perf.count[PERF_DTLB_MISS];
+        double huge = stats[i].perf.count[PERF_DTLB_MISS];
+
+        if (!stats[i].valid) {
+            printf("  %8s%9s%9s%9s%10s%10s%10s  %s\n", "-", "-", "-", "-",
+                   "-", "-", "-", stats[i].filename);
+            continue;
+        }
+        printf("  %8s%9zu%9.0f%9.0f", page_names[stats[i].pages],
+               stats[i].huge_bytes / 1024,
+               stats[i].ops / 1e3 / stats[i].small_secs,
+               stats[i].ops / 1e3 / stats[i].secs);
+        if (small >= 0 && huge >= 0)
+            printf("%10.3f%10.3f%+10.3f", small / stats[i].ops,
+                   huge / stats[i].ops, (huge - small) / stats[i].ops);
+        else
+            printf("%10s%10s%10s", "-", "-", "-");
+        printf("  %s\n", stats[i].filename);
+    }
+}
+
+/*
+ * printresults_latency - prints the latency percentiles of each op type
+ *    next to the trace's Kops, then those of each size class
+ */
+static void printresults_latency(int n, stats_t *stats)
+{
+    static const char *op_names[LAT_OPS] = {
+        "malloc", "free", "realloc", "calloc", "arena", "create", "destroy"
+    };
+    static const char *class_names[LAT_CLASSES + 1] = {
+        "<=64", "<=512", "<=4K", "<=32K", "<=256K", ">256K", "all"
+    };
+    int i, op, c;
+    lat_summary_t *s, *all;
+
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid) {
+            printf("  %s: -\n", stats[i].filename);
+            continue;
+        }
+        printf("  %s: %.0f Kops\n", stats[i].filename,
+               stats[i].secs > 0 ? stats[i].ops / 1e3 / stats[i].secs : 0);
+        printf("  %9s%8s%10s%8s%8s%8s%10s\n", "op", "size", "n", "p50",
+               "p99", "p99.9", "max");
+        for (op = 0; op < LAT_OPS; op++) {
+            all = &stats[i].lat[op][LAT_CLASSES];
+            if (all->n == 0)
+                continue;
+            printf("  %9s%8s%10lu%8llu%8llu%8llu%10llu\n", op_names[op],
+                   class_names[LAT_CLASSES], all->n, all->p50, all->p99,
+                   all->p999, all->max);
+            /* then the size classes, unless one of them is all of it */
+            for (c = 0; c < LAT_CLASSES; c++) {
+                s = &stats[i].lat[op][c];
+                if (s->n == 0 || s->n == all->n)
+                    continue;
+                printf("  %9s%8s%10lu%8llu%8llu%8llu%10llu\n", "",
+                       class_names[c], s->n, s->p50, s->p99, s->p999,
+                       s->max);
+            }
+        }
+    }
+}
+
+/*
+ * printresults_rss - prints the heap size and resident bytes sampled
+ *    over each trace, peak first
+ */
+static void printresults_rss(int n, stats_t *stats)
+{
+    int i, j;
+    size_t peak_heap, peak_rss;
+    rss_sample_t *s;
+
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || stats[i].num_rss == 0) {
+            printf("  %s: -\n", stats[i].filename);
+            continue;
+        }
+        peak_heap = peak_rss = 0;
+        for (j = 0; j < stats[i].num_rss; j++) {
+            s = &stats[i].rss[j];
+            if (s->heap > peak_heap)
+                peak_heap = s->heap;
+            if (s->rss > peak_rss)
+                peak_rss = s->rss;
+        }
+        printf("  %s: peak heap %zu KB, peak rss %zu KB\n", stats[i].filename,
+               peak_heap / 1024, peak_rss / 1024);
+        printf("  %9s%10s%10s\n", "op", "heap KB", "rss KB");
+        for (j = 0; j < stats[i].num_rss; j++) {
+            s = &stats[i].rss[j];
+            if (s->op < 0)
+                printf("  %9s", "trim");
+            else
+                printf("  %9d", s->op);
+            printf("%10zu%10zu\n", s->heap / 1024, s->rss / 1024);
+        }
+    }
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1375,7 +3362,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlBVdDNPRSW] [-f <file>] [-T <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1386,5 +3373,26 @@ static void usage(void)
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file (.rep or rep2bin output).\n");
+    fprintf(stderr, "\t-g <spec>[,<seed>] Generate the trace from a workload spec (see gen.c).\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace from n threads at once.\n");
+    fprintf(stderr, "\t-P         -T threads split each trace by block instead of each replaying it.\n");
+    fprintf(stderr, "\t-X <pct>   -T threads hand pct%% of their frees to another thread.\n");
+    fprintf(stderr, "\t-W         Sweep 1 to -T threads (default one per CPU), mm against libc.\n");
+    fprintf(stderr, "\t-C <d>[,<f>] Thread cache depth d, refill f blocks on a miss.\n");
+    fprintf(stderr, "\t-R         Print realloc counters and bytes copied.\n");
+    fprintf(stderr, "\t-S         Serve requests of up to 16 bytes from slab runs.\n");
+    fprintf(stderr, "\t-O <mask>  Keep the seglists of the classes in mask (or all) address ordered.\n");
+    fprintf(stderr, "\t-Q <n>     Defer coalescing, merge a quick list once it holds n blocks.\n");
+    fprintf(stderr, "\t-K <mode>  -D checks the whole heap (full), changed blocks (inc) or\n");
+    fprintf(stderr, "\t           a random window (sample[,<bytes>]) before each request.\n");
+    fprintf(stderr, "\t-M <n>     Sample heap size and resident memory n times a trace.\n");
+    fprintf(stderr, "\t-L         Time every request, print latency percentiles.\n");
+    fprintf(stderr, "\t-H <k>[,<file>] Write mm_stats every k requests as CSV (default mm-stats.csv).\n");
+    fprintf(stderr, "\t-p <n>[,<file>] Profile the sites of a sample per n bytes (default mm-profile.txt).\n");
+    fprintf(stderr, "\t-G <n>     Grow the heap adaptively by up to n bytes at once, 0 by fixed chunks.\n");
+    fprintf(stderr, "\t-B         Print the sbrk calls and peak footprint of each trace.\n");
+    fprintf(stderr, "\t-U <pages> Back the heap with thp or hugetlb pages, compare with base pages.\n");
+    fprintf(stderr, "\t-m <n>     Map requests of n bytes or more directly, 0 never (default adaptive).\n");
+    fprintf(stderr, "\t-N         Replay the regions of a trace as mallocs and frees, not mm_arena_*.\n");
 }
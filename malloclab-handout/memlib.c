@@ -3,7 +3,9 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE		/* mremap */
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
@@ -12,28 +14,103 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+#define HEAP_HINT		((void *)0x800000000)	/* suggested heap start */
+#define HUGE_PAGE_SIZE	(1 << 21)				/* 2MB, x86-64's */
+
+/* an anonymous mapping handed out by mem_mmap */
+typedef struct mapping {
+	char *addr;
+	size_t size;
+	struct mapping *next;
+} mapping_t;
+
 /* private variables */
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static char *mem_fresh;				/* heap from here on was never handed
+									   out, reads as zero */
+static mapping_t *mappings;		/* live mappings, newest first */
+static size_t mem_mapped_bytes;	/* bytes in live mappings */
+static size_t mem_peak;			/* largest heap size plus mapped bytes
+								   since the last reset */
+static unsigned long mem_sbrks;	/* calls that grew the heap since the
+								   last reset */
+static int pages = MEM_PAGES_SMALL;			/* backs the current heap */
+static int pages_next = MEM_PAGES_SMALL;	/* backs the next one */
+/* guards mem_brk and the mappings */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void unmap_all(void);
+
+/* raise the peak footprint to the current one, caller holds mem_lock */
+static void update_peak(void) {
+	size_t now = (size_t)(mem_brk - heap) + mem_mapped_bytes;
+
+	if (now > mem_peak)
+		mem_peak = now;
+}
+
+/*
+ * map_huge - map the heap in huge pages, or in base pages that THP may
+ *		back with huge pages, 2MB aligned so that each 2MB of growth
+ *		fills a whole huge page. Return MAP_FAILED if neither works.
+ */
+static char *map_huge(void) {
+	char *addr, *aligned;
+
+	if (pages == MEM_PAGES_HUGETLB) {
+		/* reserves the huge pages up front, so it fails right here
+		   rather than at a fault if the pool is too small */
+		addr = mmap(HEAP_HINT, MAX_HEAP, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (addr != MAP_FAILED)
+			return addr;
+		pages = MEM_PAGES_THP;
+	}
+
+	/* map a huge page more than needed and cut it to an aligned heap */
+	addr = mmap(HEAP_HINT, MAX_HEAP + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		return addr;
+	aligned = (char *)(((size_t)addr + HUGE_PAGE_SIZE - 1) &
+			~(size_t)(HUGE_PAGE_SIZE - 1));
+	if (aligned > addr)
+		munmap(addr, aligned - addr);
+	munmap(aligned + MAX_HEAP, addr + HUGE_PAGE_SIZE - aligned);
+	/* no THP in this kernel, or turned off */
+	if (madvise(aligned, MAX_HEAP, MADV_HUGEPAGE) != 0)
+		pages = MEM_PAGES_SMALL;
+	return aligned;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
+	pages = pages_next;
+	heap = pages != MEM_PAGES_SMALL ? map_huge() : MAP_FAILED;
+	if (heap == MAP_FAILED) {
+		int dev_zero = open("/dev/zero", O_RDWR);
+		pages = MEM_PAGES_SMALL;
+		heap = mmap(HEAP_HINT,				/* suggested start*/
+				MAX_HEAP,				/* length */
+				PROT_WRITE,				/* permissions */
+				MAP_PRIVATE,			/* private or shared? */
+				dev_zero,				/* fd */
+				0);						/* offset (dunno) */
+	}
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_fresh = heap;
+	mem_peak = 0;
+	mem_sbrks = 0;
 }
 
 /* 
@@ -41,35 +118,214 @@ void mem_init(void){
  */
 void mem_deinit(void){
 	munmap(heap, MAX_HEAP);
+	unmap_all();
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *		mappings the last run did not unmap are dropped too. The old
+ *		contents stay, so the heap is only fresh past the old top.
  */
 void mem_reset_brk(){
 	mem_brk = heap;
+	unmap_all();
+	mem_peak = 0;
+	mem_sbrks = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap and drops the pages past the new
+ *		brk, like a real brk would. Safe to call from several threads
+ *		at once.
  */
 void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+	char *old_brk;
+	size_t page = mem_heap_pagesize();
+
+	pthread_mutex_lock(&mem_lock);
+	old_brk = mem_brk;
+
+	if (incr < 0) {
+		if (mem_brk + incr < heap) {
+			pthread_mutex_unlock(&mem_lock);
+			errno = EINVAL;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Shrunk below the heap start\n");
+			return (void *)-1;
+		}
+		mem_brk += incr;
+		/* real sbrk() is left alone, libc may have grown the break since.
+		   Only whole heap pages go, so huge pages aren't split */
+		char *lo = heap + (mem_brk - heap + page - 1) / page * page;
+		char *hi = heap + (old_brk - heap + page - 1) / page * page;
+		if (hi > lo) {
+			madvise(lo, hi - lo, MADV_DONTNEED);
+			if (lo < mem_fresh && hi >= mem_fresh)
+				mem_fresh = lo;
+		}
+		pthread_mutex_unlock(&mem_lock);
+		return (void *)old_brk;
+	}
 
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
+	if (((mem_brk + incr) > mem_max_addr) ||
             sbrk(incr) == (void *) -1) {
+		pthread_mutex_unlock(&mem_lock);
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
 
 	mem_brk += incr;
+	if (mem_brk > mem_fresh)
+		mem_fresh = mem_brk;
+	mem_sbrks++;
+	update_peak();
+	pthread_mutex_unlock(&mem_lock);
 	return (void *)old_brk;
 }
 
+/*
+ * mem_mmap - map size bytes of fresh zeroed memory outside the heap and
+ *		return its page aligned start, or NULL. size is rounded up to
+ *		whole pages. Safe to call from several threads at once.
+ */
+void *mem_mmap(size_t size) {
+	mapping_t *m;
+	char *addr;
+
+	/* the round up to whole pages wraps */
+	if (size > SIZE_MAX - mem_pagesize()) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	size = (size + mem_pagesize() - 1) / mem_pagesize() * mem_pagesize();
+	if ((m = malloc(sizeof(*m))) == NULL)
+		return NULL;
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		free(m);
+		fprintf(stderr, "ERROR: mem_mmap failed. Ran out of memory...\n");
+		return NULL;
+	}
+	m->addr = addr;
+	m->size = size;
+
+	pthread_mutex_lock(&mem_lock);
+	m->next = mappings;
+	mappings = m;
+	mem_mapped_bytes += size;
+	update_peak();
+	pthread_mutex_unlock(&mem_lock);
+	return addr;
+}
+
+/* find the link to the mapping that starts at addr, caller holds mem_lock */
+static mapping_t **find_mapping(void *addr) {
+	mapping_t **p;
+
+	for (p = &mappings; *p != NULL; p = &(*p)->next) {
+		if ((*p)->addr == addr)
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ * mem_munmap - drop a mapping made by mem_mmap or mem_mremap, return 0 or
+ *		-1 if addr does not start one
+ */
+int mem_munmap(void *addr) {
+	mapping_t **p, *m;
+
+	pthread_mutex_lock(&mem_lock);
+	if ((p = find_mapping(addr)) == NULL) {
+		pthread_mutex_unlock(&mem_lock);
+		errno = EINVAL;
+		return -1;
+	}
+	m = *p;
+	*p = m->next;
+	mem_mapped_bytes -= m->size;
+	pthread_mutex_unlock(&mem_lock);
+
+	munmap(m->addr, m->size);
+	free(m);
+	return 0;
+}
+
+/*
+ * mem_mremap - resize a mapping to size bytes, rounded up to whole pages.
+ *		The kernel may move it, return the new start or NULL, in which
+ *		case the old mapping is left alone.
+ */
+void *mem_mremap(void *addr, size_t size) {
+	mapping_t **p, *m = NULL;
+	char *naddr;
+
+	if (size > SIZE_MAX - mem_pagesize()) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	size = (size + mem_pagesize() - 1) / mem_pagesize() * mem_pagesize();
+	/* the mapping can't be dropped meanwhile, its owner is resizing it */
+	pthread_mutex_lock(&mem_lock);
+	if ((p = find_mapping(addr)) != NULL)
+		m = *p;
+	pthread_mutex_unlock(&mem_lock);
+	if (m == NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (m->size == size)
+		return addr;
+
+	naddr = mremap(m->addr, m->size, size, MREMAP_MAYMOVE);
+	if (naddr == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_mremap failed. Ran out of memory...\n");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mem_lock);
+	mem_mapped_bytes += size - m->size;
+	m->addr = naddr;
+	m->size = size;
+	update_peak();
+	pthread_mutex_unlock(&mem_lock);
+	return naddr;
+}
+
+/*
+ * mem_is_mapped - return 1 if the bytes lo to hi lie in one live mapping
+ */
+int mem_is_mapped(void *lo, void *hi) {
+	mapping_t *m;
+	int found = 0;
+
+	pthread_mutex_lock(&mem_lock);
+	for (m = mappings; m != NULL && !found; m = m->next) {
+		found = (char *)lo >= m->addr && (char *)hi < m->addr + m->size;
+	}
+	pthread_mutex_unlock(&mem_lock);
+	return found;
+}
+
+/* drop every live mapping */
+static void unmap_all(void) {
+	mapping_t *m;
+
+	pthread_mutex_lock(&mem_lock);
+	while ((m = mappings) != NULL) {
+		mappings = m->next;
+		munmap(m->addr, m->size);
+		free(m);
+	}
+	mem_mapped_bytes = 0;
+	pthread_mutex_unlock(&mem_lock);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +340,14 @@ void *mem_heap_hi(){
 	return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_heap_fresh - return the address from which on the heap reads as
+ *		zero, the highest brk yet unless a shrink dropped the pages
+ */
+void *mem_heap_fresh(){
+	return (void *)mem_fresh;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -91,6 +355,113 @@ size_t mem_heapsize() {
 	return (size_t)((void *)mem_brk - (void *)heap);
 }
 
+/*
+ * mem_mapped() - returns the bytes in live mappings
+ */
+size_t mem_mapped() {
+	return mem_mapped_bytes;
+}
+
+/*
+ * mem_peak_footprint() - returns the largest heap size plus mapped bytes
+ *		since the last reset, both may have shrunk since
+ */
+size_t mem_peak_footprint() {
+	return mem_peak;
+}
+
+/*
+ * mem_sbrk_calls() - returns the number of mem_sbrk calls that grew the
+ *		heap since the last reset
+ */
+unsigned long mem_sbrk_calls() {
+	return mem_sbrks;
+}
+
+/* bytes of the len bytes at the page aligned addr that are resident */
+static size_t resident_bytes(char *addr, size_t len) {
+	size_t page = mem_pagesize();
+	size_t pages = (len + page - 1) / page;
+	size_t resident = 0;
+	unsigned char *vec;
+
+	if (pages == 0)
+		return 0;
+	if ((vec = malloc(pages)) == NULL)
+		return 0;
+	if (mincore(addr, pages * page, vec) == 0) {
+		for (size_t i = 0; i < pages; i++)
+			resident += vec[i] & 1;
+	}
+	free(vec);
+	return resident * page;
+}
+
+/*
+ * mem_resident() - returns the bytes of the heap and the mappings that
+ *		are resident in physical memory
+ */
+size_t mem_resident() {
+	mapping_t *m;
+	size_t resident = resident_bytes(heap, mem_heapsize());
+
+	pthread_mutex_lock(&mem_lock);
+	for (m = mappings; m != NULL; m = m->next)
+		resident += resident_bytes(m->addr, m->size);
+	pthread_mutex_unlock(&mem_lock);
+	return resident;
+}
+
+/*
+ * mem_set_pages - back the heap of the next mem_init with base pages,
+ *		THP or hugetlb pages. mem_init falls back from hugetlb pages to
+ *		THP, and from THP to base pages, when they aren't available
+ */
+void mem_set_pages(int mode) {
+	pages_next = mode;
+}
+
+/*
+ * mem_pages - returns what backs the current heap
+ */
+int mem_pages() {
+	return pages;
+}
+
+/*
+ * mem_heap_pagesize - returns the size of the pages the heap is given
+ *		back to the system in, a huge page unless it is in base pages
+ */
+size_t mem_heap_pagesize() {
+	return pages == MEM_PAGES_SMALL ? mem_pagesize() : HUGE_PAGE_SIZE;
+}
+
+/*
+ * mem_heap_huge - returns the heap bytes that are backed by huge pages
+ *		right now, from /proc/self/smaps, 0 where that isn't there
+ */
+size_t mem_heap_huge() {
+	FILE *f = fopen("/proc/self/smaps", "r");
+	char line[256];
+	unsigned long lo, hi, kb;
+	int in_heap = 0;
+	size_t huge = 0;
+
+	if (f == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+			in_heap = lo < (unsigned long)mem_max_addr &&
+				hi > (unsigned long)heap;
+		else if (in_heap &&
+				(sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+				 sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1))
+			huge += kb * 1024;
+	}
+	fclose(f);
+	return huge;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -6,6 +6,24 @@ void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_fresh(void);
 size_t mem_heapsize(void);
+void *mem_mmap(size_t size);
+int mem_munmap(void *addr);
+void *mem_mremap(void *addr, size_t size);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_mapped(void);
+size_t mem_peak_footprint(void);
+unsigned long mem_sbrk_calls(void);
+size_t mem_resident(void);
 size_t mem_pagesize(void);
 
+/* what backs the heap, from the next mem_init on */
+#define MEM_PAGES_SMALL		0	/* base pages, the default */
+#define MEM_PAGES_THP		1	/* transparent huge pages (MADV_HUGEPAGE) */
+#define MEM_PAGES_HUGETLB	2	/* MAP_HUGETLB pages, THP if the pool is short */
+void mem_set_pages(int mode);
+int mem_pages(void);			/* what backs the current heap */
+size_t mem_heap_pagesize(void);	/* page size of the current heap */
+size_t mem_heap_huge(void);		/* heap bytes backed by huge pages */
+
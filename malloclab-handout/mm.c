@@ -16,12 +16,117 @@
  *	  of header to indicate if the prev block is allocated or not
  * 4. Using each block's offset to start of the heap instead of pointer, 
  *    since heap size is less than 2^32, a WSIZE block can store the offset	  	
+ *    Built with OFS_SHIFT n (mdriver-big has 3), the offsets count units
+ *    of 2^n bytes, every block and list head being 8 byte aligned, and
+ *    the heap can be 2^(32+n) bytes with the same 4 byte links. Sizes
+ *    stay in the 4 byte header, bigger requests get their own mapping.
+ * 5. Per-thread arenas. Each arena has its own seglist heads and grows
+ *    its own segments of the mem_sbrk region. An arena that owns the heap
+ *    top extends its newest segment in place, otherwise it starts a new
+ *    segment. The segment table maps any block back to its arena. Only
+ *    the owning thread touches an arena's lists; other threads push the
+ *    blocks they free onto the arena's lock-free remote stack, which the
+ *    owner drains on its next malloc.
+ * 6. Thread cache in front of the seglists (off by default, mm_set_tcache
+ *    or mdriver -C turn it on): a bounded LIFO stack per small block
+ *    size, private to the thread. Cached blocks stay marked allocated, so
+ *    malloc and free of a cached size take no lock and no list walk, but
+ *    they don't coalesce either. On exhaust.rep that leaves the biggest
+ *    free block just short of a later 29696 byte request and util drops
+ *    from 71% to 59%. A full stack spills half of itself to the
+ *    seglists, and the whole cache is spilled before the heap grows. An
+ *    empty stack can be refilled with a batch carved from one free block
+ *    (also off by default, it costs util on the default traces).
+ * 7. Slab runs for tiny requests (slab mode, mm_set_slab). A request of
+ *    up to 16 bytes takes an 8 or 16 byte slot of a page aligned run
+ *    with an occupancy bitmap and no per-object header. A bitmap over
+ *    the heap's pages tells free that a pointer is a slab object. Each
+ *    arena keeps the runs with free slots of each size on a list. A run
+ *    itself is an allocated block of the seglist heap.
+ * 8. Memory goes back to the OS. When free leaves a free block of at
+ *    least trim_threshold at the heap top, the heap shrinks to TOP_PAD
+ *    free bytes. The threshold doubles whenever the heap grows back over
+ *    trimmed memory, so a heap that keeps breathing stops paying for
+ *    syscalls and page faults. Like glibc's, it is process wide and
+ *    survives mm_init. mm_trim also trims the top, then drops the inner
+ *    pages of every free block of the caller's arena with madvise. free
+ *    does not do that, freed blocks that merge and split again would
+ *    fault their pages right back in.
+ * 9. Requests of mmap_threshold bytes or more get their own mapping from
+ *    mem_mmap, with an 8 byte header holding the mapping's length. free
+ *    unmaps it and realloc resizes it with mem_mremap, no copy. They are
+ *    told apart by address, they lie outside the heap's offset range.
+ *    The threshold starts at MMAP_THRESHOLD and, as in glibc, rises to
+ *    the size of any bigger mapping that is freed (trim_threshold to
+ *    twice that), so blocks that come and go move to the heap. It is kept
+ *    across mm_init like trim_threshold. mm_set_mmap_threshold fixes it.
+ * 10. Free blocks of the last seglist (> 8192 bytes) are kept in a treap
+ *    keyed by (size, address) instead of a list, linked through the same
+ *    two offset words. Best fit over big blocks is O(log n) and picks the
+ *    lowest address among equal sizes.
+ * 11. Deferred coalescing (mm_set_deferred, off by default). A freed
+ *    block of up to QUICK_MAX_SIZE bytes that the thread cache doesn't
+ *    keep goes onto its arena's quick list of that exact size, still
+ *    marked allocated so nothing merges with it. malloc takes an exact
+ *    match from there before searching the seglists. A quick list is
+ *    merged into the seglists in one batch when it reaches quick_limit
+ *    blocks, and all of them are before the heap grows.
+ * 12. Built with -DTLSF (mdriver-tlsf), the seglists are indexed TLSF
+ *    style instead: a first level per power of two, split into SL_COUNT
+ *    linear second level lists, with one bitmap per level. find_fit
+ *    probes the request's own list, then takes the first block of the
+ *    first non-empty list whose blocks all fit, found with two ffs.
+ *    TLSF builds don't need the treap.
+ * 13. Seglists are LIFO unless mm_set_list_order makes their class
+ *    address ordered, a class being a list (a first level with TLSF).
+ *    Fits then come from the low end of the heap and the top stays free
+ *    to be trimmed. insert finds the place from a hint kept per list,
+ *    the last block inserted into it, walking either way from there,
+ *    so frees near each other don't walk the whole list. delete moves
+ *    the hint to the previous block when it takes the hinted one.
+ * 14. mm_checkheap walks everything by default. mm_set_check makes it
+ *    cheap enough to leave on: a bitmap of block starts is kept as
+ *    blocks split and merge, so any block can be checked alone against
+ *    its neighbours and list links. The incremental mode checks the
+ *    blocks logged as changed since the last call (the full walk if the
+ *    log overflowed), the sampling mode the blocks starting in a random
+ *    window of the heap.
+ * 15. Sampling heap profiler (mm_set_profile, off by default). About one
+ *    allocation per rate bytes has its backtrace, size and birth time
+ *    kept in side tables outside the heap, so the layout is the same
+ *    with it on. Live and cumulative bytes are summed per site (the
+ *    backtrace plus the caller's mm_profile_tag), frees of sampled
+ *    blocks add to the site's lifetimes, and mm_profile_dump writes it
+ *    all as flat text or as a pprof heap profile.
+ * 16. calloc clears only what may not be zero. fresh_lo is a watermark
+ *    of the heap: everything handed out lies below it, and above it the
+ *    heap is as mem_sbrk gave it, zero but for the links of a free block
+ *    starting at the watermark and the boundary words at a segment's
+ *    end. place raises it past each block it carves and leaves the old
+ *    value to calloc, which then clears the block below it and at its
+ *    end. Blocks from the caches were used before and are cleared whole,
+ *    mapped ones come zero from the kernel.
+ * 17. Regions (mm_arena_*, not to be confused with the thread arenas)
+ *    are for objects that die together. A region bumps a pointer through
+ *    chunks it mallocs, 4K doubling up to 64K, an object bigger than a
+ *    quarter chunk getting one of its own, and frees the chunks when it
+ *    is destroyed. Its objects have no headers and are never freed or
+ *    resized alone, so a burst of small objects costs a chunk or two of
+ *    mallocs and frees. The chunks are plain blocks, the heap checker
+ *    and mm_stats see them as such.
  */
 #include <assert.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -50,19 +155,134 @@
 /*difine constant*/
 #define WSIZE 4
 #define DSIZE 8
-#define CHUNKSIZE (1 << 8) 
+
+/*
+ * allocator policy, each one can be overridden by a config header that
+ * the Makefile force-includes: configs/<name>.h builds mdriver-<name>
+ */
+#ifndef CHUNKSIZE
+#define CHUNKSIZE (1 << 8)	//least the heap grows by
+#endif
+#define GROW_CHUNK		0	//grow by MAX(asize, CHUNKSIZE)
+#define GROW_TOP		1	//grow by what the free top block is missing
+#ifndef GROW_POLICY
+#define GROW_POLICY		GROW_CHUNK
+#endif
+#ifndef GROW_CAP
+#define GROW_CAP		(1 << 20)	//default grow_cap, 0 grows by CHUNKSIZE
+#endif
+#define FIT_BEST		0	//smallest block of the first list with a fit
+#define FIT_FIRST		1	//first block that fits
+#ifndef FIT_POLICY
+#define FIT_POLICY		FIT_BEST
+#endif
+#ifndef FOOTERS
+#define FOOTERS			0	//1: allocated blocks keep their footer too
+#endif
+#ifndef CLASS_MIN_LOG2
+#define CLASS_MIN_LOG2	4	//list 0 holds the blocks of up to 1 << this
+#endif
+#ifndef CLASS_SUB_LOG2
+#define CLASS_SUB_LOG2	0	//1 << this lists per power of two above it
+#endif
+#ifndef TREE_LOG2
+#define TREE_LOG2		13	//blocks above 1 << this are in the size tree
+#endif
+#ifndef OFS_SHIFT
+#define OFS_SHIFT		0	//links count units of 1 << this bytes
+#endif
+
+#if CLASS_MIN_LOG2 < 4 || CLASS_SUB_LOG2 > CLASS_MIN_LOG2 - 3 || \
+	TREE_LOG2 <= CLASS_MIN_LOG2
+#error "size classes need 4 <= CLASS_MIN_LOG2, CLASS_SUB_LOG2 <= \
+CLASS_MIN_LOG2 - 3 and CLASS_MIN_LOG2 < TREE_LOG2"
+#endif
+#if OFS_SHIFT < 0 || OFS_SHIFT > 3
+#error "OFS_SHIFT is 0 to 3, links can't point between 8 byte alignments"
+#endif
 
 /* define constant */
 #define MIN_FREE_SIZE	16
-#define MIN_ALLOC_SIZE	12
-#define LIST_NUM 11
-#define MAX_HEAP_SIZE 4294967296
+#define MIN_ALLOC_SIZE	(MIN_FREE_SIZE - (FOOTERS ? DSIZE : WSIZE))
+#define ALLOC_OVERHEAD	(FOOTERS ? DSIZE : WSIZE)	//bytes of an allocated
+													//block that aren't payload
+#define CLASS_SUB		(1 << CLASS_SUB_LOG2)
+#ifdef TLSF
+#define SL_LOG2		3
+#define SL_COUNT	(1 << SL_LOG2)			//second level lists per first level
+#define FL_SHIFT	(SL_LOG2 + 3)			//sizes below 1 << FL_SHIFT are in fl 0
+#define FL_COUNT	(32 - FL_SHIFT + 1)		//enough for any size below 2^32
+#define LIST_NUM	(FL_COUNT * SL_COUNT)
+#else
+#define LIST_NUM		(((TREE_LOG2 - CLASS_MIN_LOG2) << CLASS_SUB_LOG2) + 2)
+#define TREE_LIST		(LIST_NUM - 1)	//this list is kept as the size tree
+#define TREE_MIN_SIZE	((1 << TREE_LOG2) + 1)	//smallest block of TREE_LIST
+#endif
+#define MAX_HEAP_SIZE	((size_t)1 << (32 + OFS_SHIFT))
+
+/* arena constants */
+#define MAX_ARENAS		64
+#define MAX_SEGS		8192
+#define SEG_MIN_SIZE	(1 << 16)	//min size of a segment that isn't at the top
+
+/* tcache constants */
+#define TCACHE_BINS			31		//one stack per block size 16, 24, ..., 256
+#define TCACHE_MAX_SIZE		((TCACHE_BINS + 1) * DSIZE)
+#define TCACHE_DEPTH		0		//off by default, cached blocks never coalesce
+#define TCACHE_MAX_DEPTH	255
+#define TCACHE_FILL			0		//default refill batch on a miss
+
+/* adaptive growth constants */
+#define GROW_RECENT		64	//growing again within this many places speeds up
+#define GROW_MIN_SHIFT	7	//grow by at least 1/128 of the heap
+#define GROW_MAX_SHIFT	5	//and by at most 1/32 of it
+
+/* quick list constants */
+#define QUICK_MAX_SIZE		1024	//largest block size kept unmerged
+#define QUICK_BINS			(QUICK_MAX_SIZE / DSIZE - 1)	//16, 24, ..., 1024
+#define QUICK_LIMIT			0		//default quick_limit, 0 is eager
+
+/* trim constants */
+#define TRIM_THRESHOLD		(1 << 17)	//initial trim_threshold
+#define MAX_TRIM_THRESHOLD	(1 << 26)
+#define TOP_PAD				(1 << 16)	//free bytes left at the top by a trim
+
+/* mmap constants */
+#define MMAP_THRESHOLD		(1 << 17)	//initial mmap_threshold
+#define MAX_MMAP_THRESHOLD	(1 << 25)	//highest it adapts to
+#define MAP_HDR				DSIZE		//header of a mapped block
+
+/* regions of mm_arena_create */
+#define REGION_CHUNK		4096		//first chunk of a region
+#define REGION_MAX_CHUNK	(1 << 16)	//chunks double up to this size
+#define REGION_HDR			DSIZE		//link to the chunk before
+
+/* slab constants */
+#define RUN_SIZE		4096	//a slab run is one aligned page of the heap
+#define SLAB_MAX_SIZE	16		//largest request served by a slab run
+#define SLAB_CLASSES	2		//one run list per object size 8, 16
+#define SLAB_ON			0		//default slab mode
+
+/* heap checker constants */
+#define DIRTY_LOG_SIZE	4096	//blocks logged between two incremental checks
+#define CHECK_WINDOW	4096	//default bytes of a sampled window
+
+/* profiler constants */
+#define PROF_DEPTH		16		//frames of a site's backtrace
+#define PROF_SITES		16384	//sites kept, a power of two
+#define PROF_LIVE		65536	//live samples kept, a power of two
+#define PROF_FILTER		65536	//counters of the free path's filter
 
 /* rounds up to the nearest multiple of ALIGNMENT */
 #define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+/* rounds up to the nearest multiple of n */
+#define ALIGN_UP(p, n) ((((size_t)(p) + (n) - 1) / (n)) * (n))
+/* largest request, adjust_size wraps past it */
+#define MAX_REQUEST (SIZE_MAX - (ALIGNMENT + DSIZE))
 
 /*define Macros*/
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 //put size, prev allocated bit and allocated bit together
 #define PACK(size, prev_alloc, alloc)  ((size) | (prev_alloc) | (alloc)) 
 //put and get value at ptr p 
@@ -76,6 +296,9 @@
 /* get head and footer ptr for a given block ptr*/
 #define HDRP(bp)  ((char *)(bp) - WSIZE)
 #define FTRP(bp)  ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+/* write the footer of an allocated block if the config keeps them */
+#define PUT_ALLOC_FTR(bp)	do{ if(FOOTERS) \
+	PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 0, 1)); }while(0)
 
 /* for given block ptr bp, compute ptr of previous and next block
  * ptr point to start addr of effective payload
@@ -93,57 +316,368 @@
 /* the offset of prev and next free block */
 #define PREV_FREE_OFS(bp)	((char *)(bp) + WSIZE)
 #define NEXT_FREE_OFS(bp)	(bp)
+/* a link: the offset of heap ptr p from base_ptr in units of
+ * 1 << OFS_SHIFT bytes, and the ptr of a link */
+#define TO_OFS(p)	((unsigned int)((size_t)((char *)(p) - base_ptr) >> OFS_SHIFT))
+#define OFS_PTR(ofs)	(base_ptr + ((size_t)(ofs) << OFS_SHIFT))
 /* prev and next free block ptr*/
-#define NEXT_FREE_BLKP(bp)	(base_ptr + GET(NEXT_FREE_OFS(bp)))
-#define PREV_FREE_BLKP(bp)	(base_ptr + GET(PREV_FREE_OFS(bp)))
+#define NEXT_FREE_BLKP(bp)	OFS_PTR(GET(NEXT_FREE_OFS(bp)))
+#define PREV_FREE_BLKP(bp)	OFS_PTR(GET(PREV_FREE_OFS(bp)))
+
+/* links of a size tree node, 0 if none */
+#define LEFT_OFS(bp)	((unsigned int *)(bp))
+#define RIGHT_OFS(bp)	((unsigned int *)(bp) + 1)
+/* treap priority of the block at offset ofs */
+#define TREE_PRIO(ofs)	((unsigned int)(ofs) * 2654435761U)
+
+/* slab class of a request size, and a run's object size */
+#define SLAB_CLASS(size)	(((size) - 1) / DSIZE)
+#define SLAB_SIZE(c)		(((c) + 1) * DSIZE)
+/* page of the heap a ptr is in, and the slab run starting there */
+#define PAGE_INDEX(p)		((size_t)((char *)(p) - base_ptr) / RUN_SIZE)
+#define RUN_OF(p)			((slab_run_t *)(base_ptr + PAGE_INDEX(p) * RUN_SIZE))
+
+/* whether p is a mapped block, the heap is the offsets [0, MAX_HEAP_SIZE) */
+#define IS_MAPPED(p)	((size_t)((char *)(p) - base_ptr) >= MAX_HEAP_SIZE)
+/* length of the mapping of the mapped block bp */
+#define MAP_LEN(bp)		(*(size_t *)((char *)(bp) - MAP_HDR))
+
+/* slot of a ptr in the live sample table and in the free filter */
+#define PROF_HASH(p)	((size_t)(((uintptr_t)(p) >> 3) * 0x9e3779b97f4a7c15ULL >> 32))
+
+/* bit of the block start bitmap for a block ptr */
+#define START_BIT(bp)		((size_t)((char *)(bp) - base_ptr) / DSIZE)
+#define IS_START(i)			((starts[(i) / 8] >> ((i) % 8)) & 1)
+
+/* tcache stack of a block size */
+#define TCACHE_BIN(size)	(((size) / DSIZE) - 2)
+/* quick list of a block size */
+#define QUICK_BIN(size)		(((size) / DSIZE) - 2)
+
+/* mm_stats class of a free block size: <= 16, 32, ..., 8192, bigger */
+#define STATS_CLASS(size)	((size) <= 16 ? 0 : \
+	MIN(64 - __builtin_clzl((size) - 1) - 4, MM_SIZE_CLASSES - 1))
+
+/* policy class of a seglist, the unit mm_set_list_order selects by */
+#ifdef TLSF
+#define LIST_CLASS(index)	((index) / SL_COUNT)
+#else
+#define LIST_CLASS(index)	(((index) + CLASS_SUB - 1) >> CLASS_SUB_LOG2)
+#endif
+
+/* list head of index i in the current thread's arena */
+#define LIST_HEAD(i)	(arena->lists + (i) * DSIZE)
+
+/* an arena: seglist heads plus the segment it is growing */
+typedef struct arena {
+	char *lists;			//list heads, stored in the arena's prologue
+	char *epilogue;			//epilogue header of the arena's newest segment
+	unsigned int remote;	//offset of the first block freed by other threads
+	int owned;				//held by a live thread
+	int shared;				//overflow arena, always used under lock
+	//heap layout counters of mm_stats, near the fields malloc and free use
+	unsigned long alloc_blocks;	//blocks in use, runs and cached ones too
+	unsigned long splits;
+	unsigned long coalesces;
+	unsigned long placed;		//blocks placed, the clock of adaptive growth
+	unsigned long grow_placed;	//placed when the arena last grew
+	size_t grow;				//step of adaptive growth
+	pthread_mutex_t lock;	//only taken for the shared arena
+	mm_tcache_stats_t tc;	//thread cache counters of the arena's threads
+	mm_realloc_stats_t rs;	//realloc counters of the arena's threads
+	unsigned int slab[SLAB_CLASSES];	//offset of the first run with free
+										//slots of each class, 0 if none
+	unsigned int quick[QUICK_BINS];		//offset of the first block of each
+										//quick list, 0 if empty
+	unsigned short quick_count[QUICK_BINS];
+	unsigned long quick_total;			//blocks on all quick lists
+	unsigned int hint[LIST_NUM];	//offset of the block an address ordered
+									//list's inserts start from, 0 if none
+#ifdef TREE_LIST
+	unsigned int tree;		//offset of the size tree root, 0 if empty
+#endif
+#ifdef TLSF
+	unsigned int fl_bitmap;				//bit fl set if a list of fl is non-empty
+	unsigned int sl_bitmap[FL_COUNT];	//bit sl set if list (fl, sl) is non-empty
+#endif
+} arena_t;
+
+/* thread cache, the link to the next block is kept in the payload */
+typedef struct {
+	unsigned int head[TCACHE_BINS];		//offset of the top block, 0 if empty
+	unsigned char count[TCACHE_BINS];
+} tcache_t;
+
+/* header at the start of a slab run, the slots follow it */
+typedef struct {
+	unsigned int next;		//offset of the next run with free slots, 0 if none
+	unsigned int prev;		//offset of the prev one, 0 if this is the first
+	unsigned short size;	//object size
+	unsigned short used;	//number of slots handed out
+	unsigned short slots;	//number of slots of the run
+	unsigned short pad;
+	unsigned long long map[8];	//occupancy bitmap, bits past slots are set
+} slab_run_t;
+
+/* a region of mm_arena_create, kept in its first chunk */
+struct mm_arena {
+	char *chunks;			//newest chunk, the first word of each links
+							//the one before, NULL after the first
+	char *cur;				//free part of the chunk being bumped through
+	char *end;
+	size_t chunk_size;		//size of the next chunk
+};
+
+/* an allocation site of the profiler, the counts are estimates */
+typedef struct {
+	void *pc[PROF_DEPTH];	//backtrace, innermost frame first
+	int depth;				//frames in pc, 0 if the slot is empty
+	long tag;				//mm_profile_tag of the allocating thread
+	unsigned long live_blocks;
+	size_t live_bytes;
+	unsigned long alloc_blocks;
+	size_t alloc_bytes;
+	unsigned long freed;	//sampled blocks freed so far
+	double life_ns;			//their summed lifetimes
+	unsigned long tagged;	//...of them allocated and freed with a tag
+	double life_tags;		//their summed tag distances
+} prof_site_t;
+
+/* a sampled block, live until it is freed */
+typedef struct {
+	void *ptr;				//NULL if the slot is empty
+	int site;
+	unsigned long blocks;	//blocks and bytes the sample stands for
+	size_t bytes;
+	long tag;
+	unsigned long long born;	//ns
+} prof_sample_t;
+
+/* a contiguous piece of the mem_sbrk region that belongs to one arena */
+typedef struct {
+	char *lo;				//first byte (padding word)
+	char *hi;				//one past the epilogue
+	arena_t *arena;
+} seg_t;
 
 /*global variables*/
-static char *heap_list = 0;
 static char *base_ptr = 0;
+static arena_t arenas[MAX_ARENAS];
+static int arena_num = 0;
+static seg_t segs[MAX_SEGS];		//sorted by address, mem_sbrk only grows
+static int seg_num = 0;
+static unsigned int mm_epoch = 0;	//bumped by mm_init, stales old arenas
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+static int tcache_depth = TCACHE_DEPTH;
+static int tcache_fill_num = TCACHE_FILL;
+
+static int slab_on = SLAB_ON;
+
+//bit c set: the seglists of class c are address ordered, and the mask
+//mm_init switches to
+static unsigned int ao_classes = 0;
+static unsigned int ao_classes_next = 0;
+
+//most the heap grows by at once adaptively, 0 grows by CHUNKSIZE
+static size_t grow_cap = GROW_CAP;
+
+//blocks on a quick list that merge it, 0 frees eagerly
+static int quick_limit = QUICK_LIMIT;
+
+//free top block size that shrinks the heap, written under heap_lock
+static size_t trim_threshold = TRIM_THRESHOLD;
+static int trimmed = 0;				//the heap shrank since it last grew
+
+//request size that gets its own mapping, SIZE_MAX if off
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static int mmap_dynamic = 1;		//mmap_threshold adapts to frees
+static size_t mapped_bytes = 0;		//bytes in mapped blocks
+static unsigned long mapped_blocks = 0;
+//bit i set if heap page i is a slab run, non-zero below slab_pages_hi only
+static unsigned char slab_pages[MAX_HEAP_SIZE / RUN_SIZE / 8];
+static size_t slab_pages_hi = 0;
+
+//mm_checkheap mode and sampled window, and the mode mm_init switches to
+static int check_mode = MM_CHECK_FULL;
+static int check_mode_next = MM_CHECK_FULL;
+static size_t check_window = CHECK_WINDOW;
+//bit i set if a block starts at offset 8 * i, kept unless check_mode is
+//full, non-zero below starts_hi only
+static unsigned char starts[MAX_HEAP_SIZE / DSIZE / 8];
+static size_t starts_hi = 0;
+//offsets of the blocks changed since the last incremental check
+static unsigned int dirty_log[DIRTY_LOG_SIZE];
+static unsigned long dirty_num = 0;
+
+//mean bytes allocated between two profiler samples, 0 is off
+static size_t prof_rate = 0;
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static prof_site_t prof_sites[PROF_SITES];		//open addressing by backtrace
+static int prof_site_num = 0;
+static prof_sample_t prof_live[PROF_LIVE];		//open addressing by ptr
+static unsigned long prof_live_num = 0;
+//live samples per PROF_HASH slot, so a free finds out without the lock
+//that its block wasn't sampled
+static unsigned short prof_filter[PROF_FILTER];
+static unsigned long prof_dropped = 0;			//samples the tables had no room for
+
+//heap bytes from here on were never handed out, they read as zero but
+//for the links and boundary words of free blocks (see note 16)
+static char *fresh_lo = 0;
+
+/* thread's arena and cache, valid only if arena_epoch == mm_epoch */
+static __thread arena_t *arena = 0;
+static __thread unsigned int arena_epoch = 0;
+static __thread tcache_t tcache;
+/* thread's profiler state */
+static __thread long prof_left = 0;				//bytes left before the next sample
+static __thread unsigned long long prof_seed = 0;
+static __thread int prof_busy = 0;				//in the profiler, don't sample
+static __thread long prof_tag = -1;
+/* block place last carved, clean from fresh_from on, for calloc */
+static __thread char *fresh_bp = 0;
+static __thread char *fresh_from = 0;
 
 /*declaration of helper functions*/
+static void *do_malloc(size_t size);
+static void do_free(void *ptr);
+static void *do_realloc(void *oldptr, size_t size);
+static void prof_malloc(void *bp, size_t size);
 static inline void *extend_heap(size_t words);	//extend heap by n words
 static inline void *coalesce(void *bp);			//coalesce free blocks
 static inline void *find_fit(size_t asize);		//first fit: find a free block
 static inline void place(void * bp, size_t asize);
+static inline void free_block(void *bp);
+static inline size_t adjust_size(size_t size);
+static inline size_t grow_size(size_t asize);
+static void *realloc_in_place(void *bp, size_t asize);
+static size_t trim_top(size_t pad);
+static size_t release_block(void *bp);
+static inline char *use_fresh(char *end);
+
+/* functions operate arenas and segments */
+static int init_arena(arena_t *a);
+static void *add_segment(arena_t *a, size_t size);
+static arena_t *attach_arena(void);
+static void make_arena_key(void);
+static void release_arena(void *a);
+static inline arena_t *enter_arena(void);
+static inline void leave_arena(void);
+static inline arena_t *find_arena(void *bp);
+static inline void push_remote(arena_t *a, void *bp);
+static void drain_remote(void);
+
+/* functions operate the thread cache */
+static inline void tcache_push(void *bp);
+static inline void *tcache_pop(size_t bin);
+static void tcache_flush(size_t bin, int n);
+static int tcache_flush_all(void);
+static void tcache_fill(size_t asize);
+
+/* functions operate the quick lists */
+static inline void defer_block(void *bp);
+static inline void *quick_pop(size_t bin);
+static void quick_flush(size_t bin);
+static unsigned long quick_flush_all(void);
+
+/* functions operate slab runs */
+static inline int is_slab(void *bp);
+static void *slab_alloc(size_t size);
+static void slab_free(void *bp);
+static slab_run_t *new_run(size_t c);
+static inline size_t run_front(void *bp);
+static void release_run(slab_run_t *run);
+
+/* functions operate mapped blocks */
+static void *map_alloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+
+/* functions operate regions */
+static void *region_chunk(mm_arena_t *a, size_t size);
 
 /* functions operate the free list */
 static inline void insert(void *bp, size_t size);
 static inline void delete(void *bp);
 static inline size_t get_list_index(size_t size); 
+static inline char *ao_position(char *bp, size_t index);
+#ifdef TLSF
+static inline size_t get_fit_index(size_t size);
+#endif
+
+#ifdef TREE_LIST
+/* functions operate the size tree */
+static inline int tree_less(char *a, size_t asize, char *b);
+static void tree_insert(void *bp, size_t size);
+static void tree_delete(void *bp);
+static void *tree_find_fit(size_t asize);
+static int check_tree(unsigned int ofs, char *lo, char *hi, unsigned int prio);
+#endif
 
 /* checker functions */
+static inline void mark_block(void *bp);
+static inline void unmark_block(void *bp);
+static size_t next_start(size_t i, size_t end);
+static void check_heap(int verbose);
+static void check_dirty(void);
+static void check_sample(void);
+static void check_local(char *bp);
 static void checkblock(void *bp);
-static int check_free_list(void *bp);
+static int check_segment(seg_t *s, int verbose, unsigned long *alloc_blocks);
+static int check_free_list(arena_t *a);
+static void check_tcache(void);
+static void check_run(slab_run_t *run);
+static void check_quick(arena_t *a);
+static void stats_block(mm_stats_t *stats, size_t size);
+static void prof_sample(void *bp, size_t size);
+static void prof_free(void *bp);
+static void prof_reset(void);
+#ifdef TREE_LIST
+static void stats_tree(mm_stats_t *stats, unsigned int ofs);
+#endif
 
 /*
  * Initialize: return -1 on error, 0 on success.
+ * Drops every arena of the previous heap, then sets up arena 0 for the
+ * calling thread.
  */
 int mm_init(void) {
-	//initial size of the heap
-	size_t initial_szie = LIST_NUM * DSIZE + 4 * WSIZE;
-	size_t prologue_size = LIST_NUM * DSIZE + 2 * WSIZE;
-
-	if((heap_list = mem_sbrk(initial_szie)) == (void *)-1)
-	{  
- 		return -1;	//sbrk fail 
+	arena_t *a;
+
+	pthread_once(&arena_key_once, make_arena_key);
+
+	pthread_mutex_lock(&heap_lock);
+	mm_epoch++;
+	arena_num = 0;
+	seg_num = 0;
+	base_ptr = mem_heap_lo();
+	fresh_lo = mem_heap_fresh();
+	memset(slab_pages, 0, slab_pages_hi);
+	slab_pages_hi = 0;
+	ao_classes = ao_classes_next;
+	check_mode = check_mode_next;
+	memset(starts, 0, starts_hi);
+	starts_hi = 0;
+	dirty_num = 0;
+	prof_reset();
+	__atomic_store_n(&mapped_bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&mapped_blocks, 0, __ATOMIC_RELAXED);
+
+	a = &arenas[arena_num++];
+	if(init_arena(a) < 0){
+		pthread_mutex_unlock(&heap_lock);
+		return -1;	//sbrk fail
 	}
-	base_ptr = heap_list;
+	a->owned = 1;
+	pthread_mutex_unlock(&heap_lock);
 
-	PUT(heap_list, 0);		//put first word of heap of 0
-	//set the prologue's header
-	PUT(heap_list + (WSIZE), PACK(prologue_size, 2, 1));
-	//move ptr
-	heap_list += (2 * WSIZE); 		
-	//initialize the start block of the free list
-	for(int i = 0; i < LIST_NUM; i++){
-		PUT(heap_list + (i * DSIZE), ((i + 1) * DSIZE));
-		PUT(heap_list + (i * DSIZE + WSIZE), ((i + 1) * DSIZE));
-	}
-	//set the prologue's footer
-	PUT(FTRP(heap_list), PACK(prologue_size, 2, 1));
-	//set the epilogue
-	PUT(FTRP(heap_list) + WSIZE, PACK(0, 2, 1));
+	arena = a;
+	arena_epoch = mm_epoch;
+	memset(&tcache, 0, sizeof(tcache));
+	pthread_setspecific(arena_key, a);
 
     if(extend_heap(CHUNKSIZE/WSIZE) == NULL){
     	return -1;
@@ -152,121 +686,394 @@ int mm_init(void) {
 }
 
 /*
- * malloc: allocate size size free momery
+ * malloc: allocate size size free momery, the profiler samples it
  */
 void *malloc (size_t size) {
+	void *bp;
+
+	if(__builtin_expect(prof_rate == 0, 1)){
+		return do_malloc(size);
+	}
+	if((bp = do_malloc(size)) != NULL){
+		prof_malloc(bp, size);
+	}
+	return bp;
+}
+
+/*
+ * free: free an allocated block, and its sample if the profiler has one
+ */
+void free (void *ptr) {
+	if(__builtin_expect(prof_live_num != 0, 0) && ptr != NULL){
+		prof_free(ptr);
+	}
+	do_free(ptr);
+}
+
+/*
+ * realloc: resize a block, to the profiler a free and a malloc
+ */
+void *realloc(void *oldptr, size_t size) {
+	void *newptr;
+
+	if(__builtin_expect(prof_rate == 0 && prof_live_num == 0, 1)){
+		return do_realloc(oldptr, size);
+	}
+	if(oldptr != NULL){
+		prof_free(oldptr);
+	}
+	newptr = do_realloc(oldptr, size);
+	if(newptr != NULL && prof_rate != 0){
+		prof_malloc(newptr, size);
+	}
+	return newptr;
+}
+
+/*
+ * do_malloc: allocate size size free momery
+ */
+static void *do_malloc(size_t size){
 	size_t asize;
 	size_t extendsize;
 	char *bp;
 
-	if(size <= 0){
+	if(size <= 0 || size > MAX_REQUEST){
 		return NULL;
 	}
 
-	// if request size < MIN_ALLOC_SIZE
-	if(size <= MIN_ALLOC_SIZE){
-		asize = MIN_FREE_SIZE;
-	}else{
-		asize = ALIGN(size) + DSIZE;	// align the size to 8
+	//tiny request, take a slot of a slab run
+	if(size <= SLAB_MAX_SIZE && slab_on){
+		if(enter_arena() == NULL){
+			return NULL;
+		}
+		bp = slab_alloc(size);
+		leave_arena();
+		return bp;
+	}
+
+	asize = adjust_size(size);
+
+	//huge request, give it its own mapping
+	if(asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)){
+		if((bp = map_alloc(size)) != NULL){
+			return bp;
+		}
+	}
+	//a heap block's size has to fit its 4 byte header
+	if(asize > (UINT_MAX & ~0x7)){
+		return NULL;
+	}
+
+	//small request, try the thread cache first
+	if(asize <= TCACHE_MAX_SIZE && arena_epoch == mm_epoch
+		&& tcache.count[TCACHE_BIN(asize)]){
+		//no lock held, threads sharing an arena may count at once
+		__atomic_add_fetch(&arena->tc.malloc_hits, 1, __ATOMIC_RELAXED);
+		return tcache_pop(TCACHE_BIN(asize));
+	}
+
+	if(enter_arena() == NULL){
+		return NULL;
+	}
+
+	if(asize <= TCACHE_MAX_SIZE && tcache_depth > 0){
+		arena->tc.malloc_misses++;
+		if(tcache_fill_num > 0){
+			tcache_fill(asize);
+		}
+		if(tcache.count[TCACHE_BIN(asize)]){
+			bp = tcache_pop(TCACHE_BIN(asize));
+			leave_arena();
+			return bp;
+		}
+	}
+
+	//an unmerged block of the exact size
+	if(asize <= QUICK_MAX_SIZE && arena->quick[QUICK_BIN(asize)]){
+		bp = quick_pop(QUICK_BIN(asize));
+		leave_arena();
+		return bp;
 	}
 
 	if((bp = find_fit(asize)) != NULL){
 		place(bp, asize);
+		leave_arena();
 		return bp;
 	}
 
-	//find_fit return null, no free block found, request more memory
-	extendsize = MAX(asize, CHUNKSIZE);
-
-	//if prev blk is free, extendsize = extendsize - prev size
-	if(!GET_PREV_ALLOC(mem_heap_hi() - WSIZE + 1)){
-		extendsize = extendsize - GET_SIZE(mem_heap_hi() + 1 - DSIZE);
-		if(extendsize < MIN_FREE_SIZE){
-			extendsize = MIN_FREE_SIZE;
-		}
+	//before growing the heap, let the cached and unmerged blocks
+	//coalesce and retry
+	if((tcache_flush_all() + quick_flush_all()) &&
+	 (bp = find_fit(asize)) != NULL){
+		place(bp, asize);
+		leave_arena();
+		return bp;
 	}
 
+	//find_fit return null, no free block found, request more memory
+	extendsize = grow_size(asize);
+
 	if((bp = extend_heap(extendsize / WSIZE)) == NULL ){	
+		leave_arena();
+		return NULL;
+	}
+	//another arena took the heap top meanwhile, the new block is alone
+	if(GET_SIZE(HDRP(bp)) < asize &&
+	 (bp = extend_heap(MAX(asize, CHUNKSIZE) / WSIZE)) == NULL){
+		leave_arena();
 		return NULL;
 	}
 	place(bp, asize);
+	leave_arena();
 
     return bp;
 }
 
 /*
- * free: free an allocated block 
+ * do_free: free an allocated block 
  */
-void free (void *ptr) {
+static void do_free(void *ptr){
+	arena_t *owner;
 
 	if(ptr == 0)
 		return;
-	//get current block size
+
+	if(IS_MAPPED(ptr)){
+		map_free(ptr);
+		return;
+	}
+
+	owner = find_arena(ptr);
+	//block of another arena, hand it over to its owner
+	if(owner != arena || arena_epoch != mm_epoch){
+		push_remote(owner, ptr);
+		return;
+	}
+
+	if(is_slab(ptr)){
+		if(owner->shared)
+			pthread_mutex_lock(&owner->lock);
+		slab_free(ptr);
+		leave_arena();
+		return;
+	}
+
 	size_t size = GET_SIZE(HDRP(ptr));
-	//get prev allocated bit
-	size_t is_prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
-	//set header and footer of the freed block
-	PUT(HDRP(ptr), PACK(size, is_prev_alloc, 0));
-	PUT(FTRP(ptr), PACK(size, 0, 0));
+	//small block, keep it in the thread cache
+	if(size <= TCACHE_MAX_SIZE && tcache_depth > 0){
+		size_t bin = TCACHE_BIN(size);
+
+		//stack is full, spill a batch to the free lists first
+		if(tcache.count[bin] >= tcache_depth){
+			if(owner->shared)
+				pthread_mutex_lock(&owner->lock);
+			tcache_flush(bin, tcache.count[bin] - tcache_depth / 2);
+			leave_arena();
+		}
+		__atomic_add_fetch(&owner->tc.free_hits, 1, __ATOMIC_RELAXED);
+		tcache_push(ptr);
+		return;
+	}
 
-    coalesce(ptr);
+	if(owner->shared)
+		pthread_mutex_lock(&owner->lock);
+	defer_block(ptr);
+	leave_arena();
 }
 
 /*
- * realloc: change the size of an allocated block
- * using the naive method in the text book
+ * do_realloc: change the size of an allocated block
+ * A block of the current arena is shrunk or grown in place when it can
+ * be, otherwise fall back to the naive method in the text book, which
+ * is also safe for blocks owned by another thread's arena
  */
-void *realloc(void *oldptr, size_t size) {
+static void *do_realloc(void *oldptr, size_t size){
 	size_t	oldsize; 
 	void *newptr;
 
 	if(oldptr == NULL){
-		return malloc(size);
+		return do_malloc(size);
 	}
 
 	if(size == 0){
-		free(oldptr);
+		do_free(oldptr);
+		return 0;
+	}
+	if(size > MAX_REQUEST){
 		return 0;
 	}
 
-	newptr = malloc(size);
+	if(IS_MAPPED(oldptr)){
+		return map_realloc(oldptr, size);
+	}
+
+	if(is_slab(oldptr)){
+		//slab objects have no header, the slot still fits a smaller size
+		oldsize = RUN_OF(oldptr)->size;
+		if(size <= oldsize){
+			return oldptr;
+		}
+	}else{
+		//a block too big for a 4 byte header can only be mapped
+		if(find_arena(oldptr) == arena && arena_epoch == mm_epoch
+			&& adjust_size(size) <= (UINT_MAX & ~0x7)){
+			enter_arena();
+			newptr = realloc_in_place(oldptr, adjust_size(size));
+			leave_arena();
+			if(newptr != NULL){
+				return newptr;
+			}
+		}
+		//payload size, the header (and footer) aren't part of it. The
+		//owner of the block may flip its prev alloc bit meanwhile, the
+		//size is stable
+		oldsize = GET_SIZE(HDRP(oldptr)) - ALLOC_OVERHEAD;
+	}
+
+	newptr = do_malloc(size);
   	/* If realloc() fails the original block is left untouched  */
 	if(!newptr) {
 		return 0;
 	}
 
-	oldsize = GET_SIZE(HDRP(oldptr));
 	//new allocated size < oldsize
 	if(size < oldsize)
 		oldsize = size;
 
 	memcpy(newptr, oldptr, oldsize); //copy old payload
+	//a mapped newptr didn't go through the arena, it may not be set yet
+	if(enter_arena() != NULL){
+		arena->rs.moved++;
+		arena->rs.bytes_copied += oldsize;
+		leave_arena();
+	}
 
-	free(oldptr);	//free old allocated block
+	do_free(oldptr);	//free old allocated block
 
 	return newptr;
 }
 
 /*
- * calloc: set a new allocated area to 0
- * using the naive method in the text book
+ * calloc: allocate nmemb * size bytes set to 0, NULL if that overflows
+ * or is more than MAX_REQUEST.
+ * A block carved from never used heap only has the links and the footer
+ * of the free block it came from to clear, a mapped one is all zero.
  */
 void *calloc (size_t nmemb, size_t size) {
+	size_t bytes, dirty;
+	char *bp;
 
-	if (nmemb <= 0 || size <= 0)
-	{
+	if(nmemb == 0 || size == 0 || __builtin_mul_overflow(nmemb, size, &bytes)
+		|| bytes > MAX_REQUEST){
+		return NULL;
+	}
+	fresh_bp = NULL;
+	if((bp = malloc(bytes)) == NULL){
 		return NULL;
 	}
-	
-	size_t bytes = nmemb * size;
-  	void *newptr;
+	if(IS_MAPPED(bp)){
+		return bp;
+	}
+	//the cached and slab blocks were used before
+	if(bp != fresh_bp){
+		memset(bp, 0, bytes);
+		return bp;
+	}
+	//used below fresh_from, the links of a free block at it
+	dirty = fresh_from + DSIZE - bp;
+	if(dirty >= bytes){
+		memset(bp, 0, bytes);
+		return bp;
+	}
+	memset(bp, 0, dirty);
+	//the footer of the block it was carved from
+	if(bp + bytes > FTRP(bp)){
+		memset(FTRP(bp), 0, bp + bytes - FTRP(bp));
+	}
+	return bp;
+}
+
+/* adjust_size: block size of a size bytes request */
+static inline size_t adjust_size(size_t size){
+	// if request size < MIN_ALLOC_SIZE
+	if(size <= MIN_ALLOC_SIZE){
+		return MIN_FREE_SIZE;
+	}
+	return ALIGN(size) + DSIZE;	// align the size to 8
+}
+
+/*
+ * realloc_in_place: resize the allocated block bp of the current arena
+ * to asize without moving it. Shrinking splits the tail off as a free
+ * block. Growing absorbs a free next block, and if the block is the
+ * last one at the heap top, the heap is extended first. Return bp, or
+ * NULL if the block has to move. Caller holds the arena.
+ */
+static void *realloc_in_place(void *bp, size_t asize){
+	size_t csize = GET_SIZE(HDRP(bp));
+	size_t is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	char *next = NEXT_BLKP(bp);
+	size_t nsize;
+	int extended = 0;
+
+	if(asize <= csize){
+		//split the tail off if it can hold a free block
+		if(csize - asize >= MIN_FREE_SIZE){
+			PUT(HDRP(bp), PACK(asize, is_prev_alloc, 1));
+			PUT_ALLOC_FTR(bp);
+			PUT(HDRP(NEXT_BLKP(bp)), PACK(csize - asize, 2, 1));
+			mark_block(bp);
+			mark_block(NEXT_BLKP(bp));
+			arena->alloc_blocks++;
+			arena->splits++;
+			free_block(NEXT_BLKP(bp));
+			arena->rs.shrunk++;
+		}
+		return bp;
+	}
 
-	newptr = malloc(bytes);
+	//block at the heap top, or followed by a free block at the top:
+	//grow the heap by what is missing
+	if((HDRP(next) == arena->epilogue || (!GET_ALLOC(HDRP(next)) && 
+	 HDRP(NEXT_BLKP(next)) == arena->epilogue)) &&
+	 arena->epilogue + WSIZE == (char *)mem_heap_hi() + 1){
+		if(extend_heap(MAX(asize - csize, MIN_FREE_SIZE) / WSIZE) == NULL){
+			return NULL;
+		}
+		extended = 1;
+	}
 
-	//set the memory to zero
- 	memset(newptr, 0, bytes);
+	//another arena may have taken the top meanwhile, so check again
+	if(GET_ALLOC(HDRP(next))){
+		return NULL;
+	}
+	nsize = GET_SIZE(HDRP(next));
+	if(csize + nsize < asize){
+		return NULL;
+	}
 
-  	return newptr;
+	delete(next);
+	unmark_block(next);
+	mark_block(bp);
+	if(csize + nsize - asize >= MIN_FREE_SIZE){
+		//the rest stays free, the block after it already knows that
+		PUT(HDRP(bp), PACK(asize, is_prev_alloc, 1));
+		PUT_ALLOC_FTR(bp);
+		next = NEXT_BLKP(bp);
+		PUT(HDRP(next), PACK(csize + nsize - asize, 2, 0));
+		PUT(FTRP(next), PACK(csize + nsize - asize, 0, 0));
+		insert(next, csize + nsize - asize);
+		mark_block(next);
+		arena->splits++;
+	}else{
+		PUT(HDRP(bp), PACK(csize + nsize, is_prev_alloc, 1));
+		PUT_ALLOC_FTR(bp);
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+	}
+	use_fresh(NEXT_BLKP(bp));
+	arena->rs.grown++;
+	arena->rs.extended += extended;
+	return bp;
 }
 
 /*
@@ -286,27 +1093,103 @@ static int aligned(const void *p) {
 }
 
 
-//extend heap by words
+/*
+ * grow_size: bytes to grow the current arena by for a request of asize
+ * that nothing fits. With grow_cap 0 that is CHUNKSIZE. Otherwise the
+ * step doubles when the arena grows again within GROW_RECENT places of
+ * the last time and halves otherwise. It stays between 1/128 and 1/32
+ * of the heap, so small heaps don't overshoot, and at most grow_cap.
+ * With GROW_TOP the free top block's size is left out, it merges with
+ * the new memory. Caller holds the arena.
+ */
+static inline size_t grow_size(size_t asize){
+	size_t chunk = CHUNKSIZE;
+	size_t top = 0;
+
+	if(grow_cap > 0){
+		if(arena->placed - arena->grow_placed < GROW_RECENT){
+			arena->grow = MIN(2 * arena->grow, grow_cap);
+		}else{
+			arena->grow = MAX(arena->grow / 2, CHUNKSIZE);
+		}
+		arena->grow_placed = arena->placed;
+		chunk = MIN(arena->grow, MAX(mem_heapsize() >> GROW_MAX_SHIFT,
+		 CHUNKSIZE));
+		chunk = MIN(MAX(chunk, mem_heapsize() >> GROW_MIN_SHIFT), grow_cap);
+	}
+#if GROW_POLICY == GROW_TOP
+	if(!GET_PREV_ALLOC(arena->epilogue)){
+		top = MIN(GET_SIZE(arena->epilogue - WSIZE), asize);
+	}
+#endif
+	return MAX(asize - top, chunk);
+}
+
+/*
+ * extend_heap: make a free block of at least words words at the top of
+ * the current arena. If the arena owns the heap top its newest segment
+ * grows in place, and a free last block is reused, so only the
+ * difference is requested. Otherwise a new segment is started.
+ */
 static inline void *extend_heap(size_t words){
 	char *bp;
 	size_t size, is_prev_alloc;
 
 	//align the request size
 	size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-	/*extend heap*/
-	if((long)(bp = mem_sbrk(size)) == -1){
-		printf("Error: mem_sbrk failed\n");
-		return NULL;
+
+	pthread_mutex_lock(&heap_lock);
+	if(arena->epilogue + WSIZE == (char *)mem_heap_hi() + 1){
+		//if prev blk is free, size = size - prev size
+		if(!GET_PREV_ALLOC(arena->epilogue)){
+			size -= MIN(size, GET_SIZE(arena->epilogue - WSIZE));
+			if(size < MIN_FREE_SIZE){
+				size = MIN_FREE_SIZE;
+			}
+		}
+		/*extend heap*/
+		if((long)(bp = mem_sbrk(size)) == -1){
+			pthread_mutex_unlock(&heap_lock);
+			printf("Error: mem_sbrk failed\n");
+			return NULL;
+		}
+		segs[seg_num - 1].hi += size;
+		//growing back over trimmed memory, trim less eagerly
+		if(trimmed){
+			__atomic_store_n(&trim_threshold,
+			 MIN(2 * trim_threshold, MAX_TRIM_THRESHOLD), __ATOMIC_RELAXED);
+			trimmed = 0;
+		}
+		//get prev allocated bit 
+		is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	}else{
+		//another arena owns the top, the new segment holds the padding
+		//word and the epilogue besides the block
+		size = MAX(size + DSIZE, SEG_MIN_SIZE);
+		if((bp = add_segment(arena, size)) == NULL){
+			pthread_mutex_unlock(&heap_lock);
+			printf("Error: mem_sbrk failed\n");
+			return NULL;
+		}
+		size -= DSIZE;
+		is_prev_alloc = 2;
 	}
-	//get prev allocated bit 
-	is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	//the old epilogue and the last free block's footer below bp are
+	//inside the block it merges into
+	use_fresh(bp);
 	//set header and footer 
 	PUT(HDRP(bp), PACK(size, is_prev_alloc, 0));
 	PUT(FTRP(bp), PACK(size, 0, 0));
 
 	//restore epilogue
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 2, 1));
+	arena->epilogue = HDRP(NEXT_BLKP(bp));
+	if(check_mode != MM_CHECK_FULL){
+		starts_hi = MAX(starts_hi, mem_heapsize() / DSIZE / 8 + 1);
+	}
+	pthread_mutex_unlock(&heap_lock);
 
+	mark_block(bp);
 	return coalesce(bp);
 }
 
@@ -322,6 +1205,7 @@ static inline void *coalesce(void *bp){
 	if(prev_alloc && next_alloc){
 		//add a free block to free list
 		insert(bp, size);
+		mark_block(bp);
 		//set prev allocated bit of next block of current block to free
 		SET_PREV_FREE(HDRP(NEXT_BLKP(bp)));
 		return bp;
@@ -331,6 +1215,7 @@ static inline void *coalesce(void *bp){
 	else if(prev_alloc && !next_alloc){
 		//first, delete the next block from the free list
 		delete(NEXT_BLKP(bp));
+		unmark_block(NEXT_BLKP(bp));
 		//get new size
 		size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
 
@@ -338,6 +1223,8 @@ static inline void *coalesce(void *bp){
 		PUT(FTRP(bp), PACK(size, 0, 0));
 		//then, insert the new free block back to free list
 		insert(bp, size);
+		mark_block(bp);
+		arena->coalesces++;
 		return bp;
 	}
 
@@ -351,6 +1238,7 @@ static inline void *coalesce(void *bp){
 		size += GET_SIZE(HDRP(PREV_BLKP(bp)));
 
 		//move bp to prev blk
+		unmark_block(bp);
 		bp = PREV_BLKP(bp);
 
 		size_t is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
@@ -358,7 +1246,9 @@ static inline void *coalesce(void *bp){
 		PUT(HDRP(bp), PACK(size, is_prev_alloc, 0));
 		PUT(FTRP(bp), PACK(size, 0, 0));
 		//insert new free blk to list
-		insert(bp, size);	
+		insert(bp, size);
+		mark_block(bp);
+		arena->coalesces++;
 		return bp;
 	}
 
@@ -371,6 +1261,8 @@ static inline void *coalesce(void *bp){
 		//delete prev and next blocks from free list
 		delete(NEXT_BLKP(bp));
 		delete(PREV_BLKP(bp));
+		unmark_block(NEXT_BLKP(bp));
+		unmark_block(bp);
 		//move ptr to prev blk
 		bp = PREV_BLKP(bp);
 
@@ -378,24 +1270,62 @@ static inline void *coalesce(void *bp){
 		PUT(FTRP(bp), PACK(size, 0, 0));
 		//insert to free list
 		insert(bp, size);
+		mark_block(bp);
+		arena->coalesces += 2;
 		return bp;
 	}
 }
 
+#ifdef TLSF
+/* find_fit: good fit on the two-level bitmaps. The first block of the
+ * request's own list is tried, then the first block of the first
+ * non-empty list of blocks that are all >= asize.
+ */
+static inline void *find_fit(size_t asize){
+	size_t index = get_list_index(asize);
+	char *bp = NEXT_FREE_BLKP(LIST_HEAD(index));
+	size_t fl, sl;
+	unsigned int map;
+
+	if(bp != LIST_HEAD(index) && GET_SIZE(HDRP(bp)) >= asize){
+		return bp;
+	}
+
+	if((index = get_fit_index(asize)) >= LIST_NUM){
+		return NULL;
+	}
+	fl = index / SL_COUNT;
+	sl = index % SL_COUNT;
+
+	//a big enough list left in the same first level
+	map = arena->sl_bitmap[fl] & (~0U << sl);
+	if(map == 0){
+		//else the first list of the next non-empty first level
+		if(fl + 1 == FL_COUNT || 
+		 (map = arena->fl_bitmap & (~0U << (fl + 1))) == 0){
+			return NULL;		//cant find a valid block
+		}
+		fl = __builtin_ctz(map);
+		map = arena->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(map);
+	return NEXT_FREE_BLKP(LIST_HEAD(fl * SL_COUNT + sl));
+}
+#else
 /* find_fit: find a free block in the list
- * Uisng best fit 
+ * Uisng best fit, or first fit with FIT_FIRST
  */
 
 static inline void *find_fit(size_t asize){
 	void *bp;
 	void *temp;
 	size_t index = get_list_index(asize);
-	char *entry_ptr = (char *)heap_list + index * DSIZE;
+	char *entry_ptr = LIST_HEAD(index);
 
 	size_t min_size = asize;
 	void *min_ptr = NULL;
-	//outter loop: find the entry of free list
-	for(temp = entry_ptr; temp != ((char *)heap_list + LIST_NUM * DSIZE);
+	//outter loop: find the entry of free list, big blocks are in the tree
+	for(temp = entry_ptr; (char *)temp < LIST_HEAD(TREE_LIST);
 	 temp = (char *)temp + DSIZE){
 		//find a free block
 		for(bp = NEXT_FREE_BLKP(temp); bp != temp; bp = NEXT_FREE_BLKP(bp)){
@@ -403,6 +1333,9 @@ static inline void *find_fit(size_t asize){
 	 		if((GET_SIZE(HDRP(bp)) == asize) && !GET_ALLOC(HDRP(bp))){
 				return bp;			
 			}
+			if(FIT_POLICY == FIT_FIRST && GET_SIZE(HDRP(bp)) >= asize){
+				return bp;
+			}
 
 			if((GET_SIZE(HDRP(bp)) >= asize) && !GET_ALLOC(HDRP(bp))){
 				if(min_ptr == NULL || (GET_SIZE(HDRP(bp))) < min_size ){
@@ -416,20 +1349,28 @@ static inline void *find_fit(size_t asize){
 			return min_ptr;
 		}
 	}
-	return NULL;		//cant find a valid block
+	return tree_find_fit(asize);
 }
+#endif
 
 /* place: place the allocated block to free block */
 static inline void place(void * bp, size_t asize){
 	size_t csize = GET_SIZE(HDRP(bp));		//current block size
 	size_t is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	char *lo = use_fresh((char *)bp +
+	 ((csize - asize) >= MIN_FREE_SIZE ? asize : csize));
 
+	//the block is clean past the links at its start and the watermark
+	fresh_bp = bp;
+	fresh_from = MAX((char *)bp, lo);
+	mark_block(bp);
 	//if current size - request size > MIN_FREE_LIST
 	//then split the free blk
 	if((csize - asize) >= MIN_FREE_SIZE){
 		delete(bp);
 		//set the header of new allocated blk
 		PUT(HDRP(bp), PACK(asize, is_prev_alloc, 1));
+		PUT_ALLOC_FTR(bp);
 
 		/* ptr to new free block after place*/
 		bp = NEXT_BLKP(bp);
@@ -438,112 +1379,1834 @@ static inline void place(void * bp, size_t asize){
 		PUT(FTRP(bp), PACK(csize - asize, 0, 0));
 
 		insert(bp, (csize - asize));
+		mark_block(bp);
+		arena->splits++;
 	} 
 	//do not split the free block
 	else{
 		delete(bp);
 		PUT(HDRP(bp), PACK(csize, 2, 1));
+		PUT_ALLOC_FTR(bp);
 		SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
 	}
+	arena->alloc_blocks++;
+	arena->placed++;
 }
 
-//insert a free block, always insert it to the start of the list
+//insert a free block, at the start of the list or in address order
 static inline void insert(void *bp, size_t size){
 	size_t index = get_list_index(size);
+	char *prev = LIST_HEAD(index);
+
+#ifdef TREE_LIST
+	if(index == TREE_LIST){
+		tree_insert(bp, size);
+		return;
+	}
+#endif
+	if(ao_classes & (1U << LIST_CLASS(index))){
+		prev = ao_position(bp, index);
+	}
 	//set the current blk's next free blk's offset
-	PUT(NEXT_FREE_OFS(bp), GET((char *)heap_list + (index * DSIZE)));
+	PUT(NEXT_FREE_OFS(bp), GET(NEXT_FREE_OFS(prev)));
 	//set the current blk's prev free blk's offset
-	PUT(PREV_FREE_OFS(bp), GET(PREV_FREE_OFS(NEXT_FREE_BLKP(bp))));
+	PUT(PREV_FREE_OFS(bp), TO_OFS(prev));
 	//set the prev blk's next free blk's offset
-	PUT(NEXT_FREE_OFS((char *)heap_list + index * DSIZE),
-	 (long)bp - (long)base_ptr);
+	PUT(NEXT_FREE_OFS(prev), TO_OFS(bp));
 	//set the next blk's prev free blk's offset
-	PUT(PREV_FREE_OFS(NEXT_FREE_BLKP(bp)), (long)bp - (long)base_ptr);
+	PUT(PREV_FREE_OFS(NEXT_FREE_BLKP(bp)), TO_OFS(bp));
+#ifdef TLSF
+	arena->sl_bitmap[index / SL_COUNT] |= 1U << (index % SL_COUNT);
+	arena->fl_bitmap |= 1U << (index / SL_COUNT);
+#endif
 }
 
 //remove the free blk from the list
 static inline void delete(void *bp){
+#ifdef TREE_LIST
+	//the header still has the size the block was inserted with
+	if(GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE){
+		tree_delete(bp);
+		return;
+	}
+#endif
+	//don't leave the hint on a block that is no longer in the list
+	if(ao_classes){
+		size_t index = get_list_index(GET_SIZE(HDRP(bp)));
+
+		if(arena->hint[index] == TO_OFS(bp)){
+			arena->hint[index] = GET(PREV_FREE_OFS(bp));
+		}
+	}
 	//put prev free blk offset to next free blk
 	PUT(NEXT_FREE_OFS(PREV_FREE_BLKP(bp)), GET(NEXT_FREE_OFS(bp)));
 	//put next free blk offset to prev free blk
 	PUT(PREV_FREE_OFS(NEXT_FREE_BLKP(bp)), GET(PREV_FREE_OFS(bp)));
+#ifdef TLSF
+	//only the list head is left, clear the list's bits
+	if(PREV_FREE_BLKP(bp) == NEXT_FREE_BLKP(bp)){
+		size_t index = (PREV_FREE_BLKP(bp) - arena->lists) / DSIZE;
+		size_t fl = index / SL_COUNT;
+
+		arena->sl_bitmap[fl] &= ~(1U << (index % SL_COUNT));
+		if(arena->sl_bitmap[fl] == 0){
+			arena->fl_bitmap &= ~(1U << fl);
+		}
+	}
+#endif
+}
+
+/*
+ * ao_position: the block of the address ordered list index that bp goes
+ * after, the list head if none. The walk starts at the list's hint,
+ * backwards if the hint lies above bp, and bp becomes the new hint.
+ */
+static inline char *ao_position(char *bp, size_t index){
+	char *head = LIST_HEAD(index);
+	char *p = arena->hint[index] ? OFS_PTR(arena->hint[index]) : head;
+
+	if(p != head && p > bp){
+		do{
+			p = PREV_FREE_BLKP(p);
+		}while(p != head && p > bp);
+	}
+	else{
+		while(NEXT_FREE_BLKP(p) != head && NEXT_FREE_BLKP(p) < bp){
+			p = NEXT_FREE_BLKP(p);
+		}
+	}
+	arena->hint[index] = TO_OFS(bp);
+	return p;
 }
 
-/* get the list index upon the size of the free blk */
+#ifdef TLSF
+/* get the list index upon the size of the free blk:
+ * fl 0 holds the small sizes in steps of DSIZE, above that fl is the
+ * power of two and sl the next SL_LOG2 bits of the size
+ */
 static inline size_t get_list_index(size_t size){
-	if(size <= 16)
-		return 0;
-	else if(size <= 32)
-		return 1;
-	else if(size <= 64)
-		return 2;
-	else if(size <= 128)
-		return 3;
-	else if(size <= 256)
-		return 4;
-	else if(size <= 512)
-		return 5;
-	else if(size <= 1024)
-		return 6;
-	else if(size <= 2048)
-		return 7;
-	else if(size <= 4096)
-		return 8;
-	else if(size <= 8192)
-		return 9;
-	else 
-		return 10;
+	size_t f;
+
+	if(size < (1 << FL_SHIFT)){
+		return size / DSIZE;
+	}
+	f = 63 - __builtin_clzl(size);
+	return (f - FL_SHIFT + 1) * SL_COUNT + ((size >> (f - SL_LOG2)) - SL_COUNT);
+}
+
+/* the first list whose blocks are all >= size, may be LIST_NUM */
+static inline size_t get_fit_index(size_t size){
+	if(size >= (1 << FL_SHIFT)){
+		size += (1UL << (63 - __builtin_clzl(size) - SL_LOG2)) - 1;
+	}
+	return get_list_index(size);
+}
+#else
+/* get the list index upon the size of the free blk: list 0 holds the
+ * sizes up to 1 << CLASS_MIN_LOG2, then each power of two (2^f, 2^(f+1)]
+ * is split into CLASS_SUB lists, and TREE_LIST takes the rest. No
+ * branches, the compares become conditional moves.
+ */
+static inline size_t get_list_index(size_t size){
+	size_t v = size - 1;
+	size_t f = 63 - __builtin_clzl(v | (1 << CLASS_MIN_LOG2));
+	size_t index = ((f - CLASS_MIN_LOG2) << CLASS_SUB_LOG2) +
+	 ((v >> (f - CLASS_SUB_LOG2)) & (CLASS_SUB - 1)) + 1;
+
+	index = v < (1 << CLASS_MIN_LOG2) ? 0 : index;
+	return MIN(index, TREE_LIST);
 }
 
 /*******************************
- 	   	check funcitons
+ 	   	size tree functions
  ******************************/
 
-/*
- * mm_checkheap: 
- */
-void mm_checkheap(int verbose) {
+/* tree_less: order of the tree, by size then by address */
+static inline int tree_less(char *a, size_t asize, char *b){
+	size_t bsize = GET_SIZE(HDRP(b));
 
-	char *bp = heap_list;
-	char *epilogue_ptr = mem_heap_hi() - WSIZE + 1;
-	size_t prologue_size = LIST_NUM * DSIZE + 2 * WSIZE;
+	return asize < bsize || (asize == bsize && a < b);
+}
 
-	if(verbose){
-		printf("Heap starts @ [%p]\n", base_ptr );
-		printf("----------------------------------\n");
-	}
-	/*check the szie of the heap*/
-	if(mem_heapsize() > MAX_HEAP_SIZE){
-		printf("Error: Heap size [%d] bytes, violate heap size limitation\n",
-		 (int)mem_heapsize());
+/*
+ * tree_insert: put a free block into the arena's size tree. Walk down
+ * while the nodes have a higher priority, then split the subtree there
+ * around bp, whose children become the two halves.
+ */
+static void tree_insert(void *bp, size_t size){
+	unsigned int ofs = TO_OFS(bp);
+	unsigned int *link = &arena->tree;
+	unsigned int *l = LEFT_OFS(bp);
+	unsigned int *r = RIGHT_OFS(bp);
+	unsigned int t;
+
+	while(*link && TREE_PRIO(*link) > TREE_PRIO(ofs)){
+		char *node = OFS_PTR(*link);
+		link = tree_less(bp, size, node) ? LEFT_OFS(node) : RIGHT_OFS(node);
 	}
 
-	/*check first word of the heap, it should be 0 padding*/
-	if((GET(mem_heap_lo()) != 0)){
-		printf("%s\n","Error: first word should be 0 padding");
+	//split: nodes less than bp go to its left, the others to its right
+	for(t = *link; t; ){
+		char *node = OFS_PTR(t);
+
+		if(tree_less(node, GET_SIZE(HDRP(node)), bp)){
+			*l = t;
+			l = RIGHT_OFS(node);
+			t = *l;
+		}else{
+			*r = t;
+			r = LEFT_OFS(node);
+			t = *r;
+		}
 	}
+	*l = 0;
+	*r = 0;
+	*link = ofs;
+}
 
-	/* check prologue */
-	if((GET_SIZE(HDRP(bp)) != prologue_size) || (GET_ALLOC(HDRP(bp)) != 1) 
-		|| (GET_PREV_ALLOC(HDRP(bp)) != 2)){
-		printf("%s\n", "Error: invalid prologue");
-	}
-	if(GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))){
-		printf("%s\n", "Error: prologue sizes in \
-			header and footer do not match");
-	}
-	if(GET_ALLOC(HDRP(bp)) != GET_ALLOC(FTRP(bp))){
-		printf("%s\n", "Error: allocated bit in \
-			header and footer do not match");
+/*
+ * tree_delete: remove a free block from the arena's size tree, its two
+ * subtrees are merged in its place by priority
+ */
+static void tree_delete(void *bp){
+	size_t size = GET_SIZE(HDRP(bp));
+	unsigned int *link = &arena->tree;
+	unsigned int l = *LEFT_OFS(bp);
+	unsigned int r = *RIGHT_OFS(bp);
+
+	while(OFS_PTR(*link) != bp){
+		char *node = OFS_PTR(*link);
+		link = tree_less(bp, size, node) ? LEFT_OFS(node) : RIGHT_OFS(node);
 	}
 
-	if(verbose){
-		printf("prologue @ [%p], prologue size is %d\n", 
-			bp, (int)prologue_size);
-		printf("----------------------------------\n");
+	//every node of l is less than every node of r
+	while(l && r){
+		if(TREE_PRIO(l) > TREE_PRIO(r)){
+			*link = l;
+			link = RIGHT_OFS(OFS_PTR(l));
+			l = *link;
+		}else{
+			*link = r;
+			link = LEFT_OFS(OFS_PTR(r));
+			r = *link;
+		}
 	}
+	*link = l ? l : r;
+}
 
-	/* check epilogue */
+/* tree_find_fit: the smallest block >= asize, lowest address first */
+static void *tree_find_fit(size_t asize){
+	unsigned int t = arena->tree;
+	char *best = NULL;
+
+	while(t){
+		char *node = OFS_PTR(t);
+
+		if(GET_SIZE(HDRP(node)) >= asize){
+			best = node;
+			t = *LEFT_OFS(node);
+		}else{
+			t = *RIGHT_OFS(node);
+		}
+	}
+	return best;
+}
+#endif
+
+/*******************************
+ 	   	arena functions
+ ******************************/
+
+/* free_block: mark a block of the current arena free and coalesce it */
+static inline void free_block(void *bp){
+	//get current block size
+	size_t size = GET_SIZE(HDRP(bp));
+	//get prev allocated bit
+	size_t is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	//set header and footer of the freed block
+	PUT(HDRP(bp), PACK(size, is_prev_alloc, 0));
+	PUT(FTRP(bp), PACK(size, 0, 0));
+	arena->alloc_blocks--;
+
+    bp = coalesce(bp);
+
+	//a big free block at the heap top goes back
+	if(GET_SIZE(HDRP(bp)) >= __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED)
+	 && HDRP(NEXT_BLKP(bp)) == arena->epilogue){
+		trim_top(TOP_PAD);
+	}
+}
+
+/*
+ * trim_top: if the current arena owns the heap top and its last block is
+ * free, shrink the heap so that at most pad bytes of it are left. Return
+ * the number of bytes given back. Caller holds the arena.
+ */
+static size_t trim_top(size_t pad){
+	char *bp;
+	size_t size, keep;
+
+	pad = ALIGN(pad);
+	if(pad > 0 && pad < MIN_FREE_SIZE){
+		pad = MIN_FREE_SIZE;
+	}
+
+	pthread_mutex_lock(&heap_lock);
+	if(arena->epilogue + WSIZE != (char *)mem_heap_hi() + 1 ||
+	 GET_PREV_ALLOC(arena->epilogue)){
+		pthread_mutex_unlock(&heap_lock);
+		return 0;
+	}
+	size = GET_SIZE(arena->epilogue - WSIZE);
+	bp = arena->epilogue + WSIZE - size;
+	//not worth a page of the heap, a huge page if it has them
+	if(size <= pad || size - pad < mem_heap_pagesize()){
+		pthread_mutex_unlock(&heap_lock);
+		return 0;
+	}
+	keep = pad;
+
+	delete(bp);
+	if(keep > 0){
+		PUT(HDRP(bp), PACK(keep, GET_PREV_ALLOC(HDRP(bp)), 0));
+		PUT(FTRP(bp), PACK(keep, 0, 0));
+		insert(bp, keep);
+		mark_block(bp);
+	}else{
+		unmark_block(bp);
+	}
+	//a free block's prev block is allocated
+	arena->epilogue = HDRP(bp) + keep;
+	PUT(arena->epilogue, PACK(0, keep > 0 ? 0 : 2, 1));
+
+	mem_sbrk(-(int)(size - keep));
+	segs[seg_num - 1].hi -= size - keep;
+	trimmed = 1;
+	pthread_mutex_unlock(&heap_lock);
+	return size - keep;
+}
+
+/*
+ * release_block: drop the pages inside the free block bp, they read as
+ * zero on the next touch. The links at its start and the footer stay.
+ * Return the number of bytes dropped.
+ */
+static size_t release_block(void *bp){
+	size_t page = mem_heap_pagesize();
+	char *lo = base_ptr + ALIGN_UP((char *)bp + DSIZE - base_ptr, page);
+	char *hi = base_ptr + ((FTRP(bp) - base_ptr) / page) * page;
+
+	if(hi <= lo){
+		return 0;
+	}
+	madvise(lo, hi - lo, MADV_DONTNEED);
+	return hi - lo;
+}
+
+/*
+ * use_fresh: the heap below end is handed out, raise the watermark to
+ * it. Return the old watermark.
+ */
+static inline char *use_fresh(char *end){
+	char *lo = __atomic_load_n(&fresh_lo, __ATOMIC_RELAXED);
+
+	while(lo < end && !__atomic_compare_exchange_n(&fresh_lo, &lo, end, 1,
+	 __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return lo;
+}
+
+/*
+ * init_arena: start the first segment of arena a, which only holds the
+ * prologue (carrying the list heads) and the epilogue.
+ * Caller holds heap_lock.
+ */
+static int init_arena(arena_t *a){
+	//initial size of the segment
+	size_t initial_szie = LIST_NUM * DSIZE + 4 * WSIZE;
+	size_t prologue_size = LIST_NUM * DSIZE + 2 * WSIZE;
+	char *bp;
+
+	if((bp = add_segment(a, initial_szie)) == NULL){
+		return -1;
+	}
+	//set the prologue's header
+	PUT(HDRP(bp), PACK(prologue_size, 2, 1));
+	//initialize the start block of the free list
+	for(int i = 0; i < LIST_NUM; i++){
+		PUT(bp + (i * DSIZE), TO_OFS(bp + i * DSIZE));
+		PUT(bp + (i * DSIZE + WSIZE), TO_OFS(bp + i * DSIZE));
+	}
+	//set the prologue's footer
+	PUT(FTRP(bp), PACK(prologue_size, 2, 1));
+	//set the epilogue
+	PUT(FTRP(bp) + WSIZE, PACK(0, 2, 1));
+
+	a->lists = bp;
+	a->epilogue = FTRP(bp) + WSIZE;
+	a->remote = 0;
+	a->shared = 0;
+	memset(&a->tc, 0, sizeof(a->tc));
+	memset(&a->rs, 0, sizeof(a->rs));
+	a->alloc_blocks = 0;
+	a->splits = 0;
+	a->coalesces = 0;
+	a->placed = 0;
+	a->grow_placed = 0;
+	a->grow = CHUNKSIZE;
+	memset(a->quick, 0, sizeof(a->quick));
+	memset(a->quick_count, 0, sizeof(a->quick_count));
+	a->quick_total = 0;
+	memset(a->hint, 0, sizeof(a->hint));
+	memset(a->slab, 0, sizeof(a->slab));
+#ifdef TREE_LIST
+	a->tree = 0;
+#endif
+#ifdef TLSF
+	a->fl_bitmap = 0;
+	memset(a->sl_bitmap, 0, sizeof(a->sl_bitmap));
+#endif
+	return 0;
+}
+
+/*
+ * add_segment: sbrk size bytes as a new segment of arena a and put
+ * the padding word. Return the bp of its first block.
+ * Caller holds heap_lock.
+ */
+static void *add_segment(arena_t *a, size_t size){
+	char *lo;
+
+	if(seg_num == MAX_SEGS){
+		printf("Error: segment table is full\n");
+		return NULL;
+	}
+	if((lo = mem_sbrk(size)) == (void *)-1){
+		return NULL;
+	}
+	PUT(lo, 0);		//put first word of segment of 0
+
+	segs[seg_num].lo = lo;
+	segs[seg_num].hi = lo + size;
+	segs[seg_num].arena = a;
+	//publish the entry only after it is filled
+	__atomic_store_n(&seg_num, seg_num + 1, __ATOMIC_RELEASE);
+
+	return lo + DSIZE;
+}
+
+/*
+ * attach_arena: bind the calling thread to an arena. Reuse one released
+ * by an exited thread, else create a new one. Once MAX_ARENAS - 1 owned
+ * arenas exist, further threads share a single arena under its lock.
+ */
+static arena_t *attach_arena(void){
+	arena_t *a = NULL;
+	int i;
+
+	pthread_once(&arena_key_once, make_arena_key);
+
+	pthread_mutex_lock(&heap_lock);
+	for(i = 0; i < arena_num; i++){
+		if(!arenas[i].shared && !__atomic_load_n(&arenas[i].owned,
+		 __ATOMIC_ACQUIRE)){
+			a = &arenas[i];
+			break;
+		}
+	}
+	if(a == NULL && arena_num < MAX_ARENAS - 1){
+		a = &arenas[arena_num];
+		if(init_arena(a) < 0){
+			pthread_mutex_unlock(&heap_lock);
+			return NULL;
+		}
+		__atomic_store_n(&arena_num, arena_num + 1, __ATOMIC_RELEASE);
+	}
+	if(a == NULL){
+		//find or create the shared arena
+		for(i = 0; i < arena_num; i++){
+			if(arenas[i].shared){
+				a = &arenas[i];
+			}
+		}
+		if(a == NULL){
+			a = &arenas[arena_num];
+			if(init_arena(a) < 0){
+				pthread_mutex_unlock(&heap_lock);
+				return NULL;
+			}
+			pthread_mutex_init(&a->lock, NULL);
+			a->shared = 1;
+			__atomic_store_n(&arena_num, arena_num + 1, __ATOMIC_RELEASE);
+		}
+	}
+	a->owned = 1;
+	pthread_mutex_unlock(&heap_lock);
+
+	arena = a;
+	arena_epoch = mm_epoch;
+	memset(&tcache, 0, sizeof(tcache));
+	pthread_setspecific(arena_key, a);
+	return a;
+}
+
+/* make_arena_key: the key whose destructor releases a thread's arena */
+static void make_arena_key(void){
+	pthread_key_create(&arena_key, release_arena);
+}
+
+/*
+ * release_arena: runs at thread exit, gives the thread cache back to the
+ * free lists and lets another thread adopt the arena
+ */
+static void release_arena(void *a){
+	if(arena_epoch != mm_epoch || a != arena){
+		return;
+	}
+	if(arena->shared)
+		pthread_mutex_lock(&arena->lock);
+	tcache_flush_all();
+	if(arena->shared)
+		pthread_mutex_unlock(&arena->lock);
+	else
+		__atomic_store_n(&arena->owned, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * enter_arena: make sure the thread has an arena of the current heap,
+ * lock it if it is shared and take back the blocks other threads freed
+ */
+static inline arena_t *enter_arena(void){
+	if(arena_epoch != mm_epoch && attach_arena() == NULL){
+		return NULL;
+	}
+	if(arena->shared){
+		pthread_mutex_lock(&arena->lock);
+	}
+	if(__atomic_load_n(&arena->remote, __ATOMIC_RELAXED)){
+		drain_remote();
+	}
+	return arena;
+}
+
+/* leave_arena: undo the lock taken by enter_arena */
+static inline void leave_arena(void){
+	if(arena->shared){
+		pthread_mutex_unlock(&arena->lock);
+	}
+}
+
+/* find_arena: binary search the segment table for the owner of bp */
+static inline arena_t *find_arena(void *bp){
+	int lo = 0;
+	int hi = __atomic_load_n(&seg_num, __ATOMIC_ACQUIRE) - 1;
+
+	if(__atomic_load_n(&arena_num, __ATOMIC_RELAXED) == 1){
+		return &arenas[0];
+	}
+	while(lo < hi){
+		int mid = (lo + hi + 1) / 2;
+		if(segs[mid].lo <= (char *)bp)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return segs[lo].arena;
+}
+
+/*
+ * push_remote: free a block owned by another arena by pushing it onto
+ * that arena's remote stack, the link is kept in the payload
+ */
+static inline void push_remote(arena_t *a, void *bp){
+	unsigned int ofs = TO_OFS(bp);
+	unsigned int head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+	do{
+		PUT(bp, head);
+	}while(!__atomic_compare_exchange_n(&a->remote, &head, ofs, 1,
+	 __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* drain_remote: free every block on the current arena's remote stack */
+static void drain_remote(void){
+	unsigned int ofs = __atomic_exchange_n(&arena->remote, 0,
+	 __ATOMIC_ACQUIRE);
+
+	while(ofs != 0){
+		char *bp = OFS_PTR(ofs);
+		ofs = GET(bp);
+		if(is_slab(bp))
+			slab_free(bp);
+		else
+			defer_block(bp);
+	}
+}
+
+/*******************************
+ 	   	thread cache functions
+ ******************************/
+
+/* tcache_push: put an allocated block on top of its size's stack */
+static inline void tcache_push(void *bp){
+	size_t bin = TCACHE_BIN(GET_SIZE(HDRP(bp)));
+
+	PUT(bp, tcache.head[bin]);
+	tcache.head[bin] = TO_OFS(bp);
+	tcache.count[bin]++;
+}
+
+/* tcache_pop: take the top block of a non-empty stack */
+static inline void *tcache_pop(size_t bin){
+	char *bp = OFS_PTR(tcache.head[bin]);
+
+	tcache.head[bin] = GET(bp);
+	tcache.count[bin]--;
+	return bp;
+}
+
+/*
+ * tcache_flush: free the top n blocks of a stack into the seglists.
+ * Caller holds the arena.
+ */
+static void tcache_flush(size_t bin, int n){
+	arena->tc.flushed += n;
+	while(n-- > 0){
+		free_block(tcache_pop(bin));
+	}
+}
+
+/* tcache_flush_all: empty every stack, return the number of blocks freed */
+static int tcache_flush_all(void){
+	int n = 0;
+
+	for(size_t bin = 0; bin < TCACHE_BINS; bin++){
+		n += tcache.count[bin];
+		tcache_flush(bin, tcache.count[bin]);
+	}
+	return n;
+}
+
+/*
+ * tcache_fill: on a miss, carve a batch of asize blocks out of one free
+ * block the seglists already have. Only the first block of each big
+ * enough list is probed, and the heap is never extended for it. Note the
+ * batch is spilled again if the heap has to grow, so big batches churn
+ * on traces that rarely free. Caller holds the arena.
+ */
+static void tcache_fill(size_t asize){
+	size_t n = MIN(tcache_fill_num, tcache_depth);
+	size_t csize;
+	char *bp = NULL;
+
+	for(size_t i = get_list_index(n * asize); i < LIST_NUM; i++){
+		char *first = NEXT_FREE_BLKP(LIST_HEAD(i));
+
+		if(first != LIST_HEAD(i) && GET_SIZE(HDRP(first)) >= n * asize){
+			bp = first;
+			break;
+		}
+	}
+#ifdef TREE_LIST
+	if(bp == NULL){
+		bp = tree_find_fit(n * asize);
+	}
+#endif
+	if(bp == NULL){
+		return;
+	}
+	place(bp, n * asize);
+	//place may leave a slightly bigger block, the last piece takes the rest
+	csize = GET_SIZE(HDRP(bp));
+	for(size_t i = 1; i < n; i++){
+		PUT(HDRP(bp + i * asize), PACK(asize, 2, 1));
+		mark_block(bp + i * asize);
+	}
+	PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)), 1));
+	PUT(HDRP(bp + (n - 1) * asize), PACK(csize - (n - 1) * asize, 2, 1));
+	arena->alloc_blocks += n - 1;
+	arena->splits += n - 1;
+
+	for(size_t i = 0; i < n; i++, bp = NEXT_BLKP(bp)){
+		size_t size = GET_SIZE(HDRP(bp));
+
+		PUT_ALLOC_FTR(bp);
+		if(size > TCACHE_MAX_SIZE
+			|| tcache.count[TCACHE_BIN(size)] >= tcache_depth){
+			free_block(bp);
+		}else{
+			tcache_push(bp);
+			arena->tc.refilled++;
+		}
+	}
+}
+
+/*
+ * mm_set_tcache: set the max number of blocks per stack (0 turns the
+ * thread cache off) and the number of blocks refilled on a miss
+ */
+void mm_set_tcache(int depth, int fill){
+	tcache_depth = MIN(MAX(depth, 0), TCACHE_MAX_DEPTH);
+	tcache_fill_num = MIN(MAX(fill, 0), tcache_depth);
+}
+
+/* mm_tcache_stats: sum the thread cache counters of every arena */
+void mm_tcache_stats(mm_tcache_stats_t *stats){
+	memset(stats, 0, sizeof(*stats));
+	for(int i = 0; i < arena_num; i++){
+		stats->malloc_hits += __atomic_load_n(&arenas[i].tc.malloc_hits,
+		 __ATOMIC_RELAXED);
+		stats->malloc_misses += arenas[i].tc.malloc_misses;
+		stats->free_hits += __atomic_load_n(&arenas[i].tc.free_hits,
+		 __ATOMIC_RELAXED);
+		stats->flushed += arenas[i].tc.flushed;
+		stats->refilled += arenas[i].tc.refilled;
+	}
+}
+
+/*******************************
+ 	   	quick list functions
+ ******************************/
+
+/*
+ * defer_block: free a block of the current arena. In deferred mode a
+ * small one goes onto its quick list unmerged, the link is kept in the
+ * payload, and a list that reaches quick_limit is merged in one go.
+ * Caller holds the arena.
+ */
+static inline void defer_block(void *bp){
+	size_t size = GET_SIZE(HDRP(bp));
+	size_t bin;
+
+	if(quick_limit == 0 || size > QUICK_MAX_SIZE){
+		free_block(bp);
+		return;
+	}
+	bin = QUICK_BIN(size);
+	PUT(bp, arena->quick[bin]);
+	arena->quick[bin] = TO_OFS(bp);
+	arena->quick_total++;
+	if(++arena->quick_count[bin] >= quick_limit){
+		quick_flush(bin);
+	}
+}
+
+/* quick_pop: take the first block of a non-empty quick list */
+static inline void *quick_pop(size_t bin){
+	char *bp = OFS_PTR(arena->quick[bin]);
+
+	arena->quick[bin] = GET(bp);
+	arena->quick_count[bin]--;
+	arena->quick_total--;
+	return bp;
+}
+
+/* quick_flush: merge every block of a quick list. Caller holds the arena. */
+static void quick_flush(size_t bin){
+	while(arena->quick[bin]){
+		free_block(quick_pop(bin));
+	}
+}
+
+/* quick_flush_all: merge every quick list, return the number of blocks */
+static unsigned long quick_flush_all(void){
+	unsigned long n = arena->quick_total;
+
+	for(size_t bin = 0; bin < QUICK_BINS && arena->quick_total; bin++){
+		quick_flush(bin);
+	}
+	return n;
+}
+
+/*
+ * mm_set_deferred: defer coalescing, merging a quick list once it holds
+ * limit blocks, or free eagerly again if limit is 0. Blocks already on
+ * quick lists are merged when the heap next grows.
+ */
+void mm_set_deferred(int limit){
+	quick_limit = MIN(MAX(limit, 0), USHRT_MAX);
+}
+
+/*
+ * mm_trim: give the free memory of the caller's arena back to the OS.
+ * The heap top is trimmed down to pad free bytes if the arena owns it,
+ * the inner pages of every other free block are dropped. Return 1 if
+ * any memory was released, like malloc_trim.
+ */
+int mm_trim(size_t pad){
+	size_t released = 0;
+
+	if(enter_arena() == NULL){
+		return 0;
+	}
+	//let the cached and unmerged blocks coalesce first
+	tcache_flush_all();
+	quick_flush_all();
+	released += trim_top(pad);
+
+	for(int i = 0; i < __atomic_load_n(&seg_num, __ATOMIC_ACQUIRE); i++){
+		char *bp;
+
+		if(segs[i].arena != arena){
+			continue;
+		}
+		for(bp = segs[i].lo + DSIZE; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+			if(!GET_ALLOC(HDRP(bp))){
+				released += release_block(bp);
+			}
+		}
+	}
+	leave_arena();
+	return released > 0;
+}
+
+/* mm_realloc_stats: sum the realloc counters of all arenas */
+void mm_realloc_stats(mm_realloc_stats_t *stats){
+	memset(stats, 0, sizeof(*stats));
+	for(int i = 0; i < arena_num; i++){
+		stats->shrunk += arenas[i].rs.shrunk;
+		stats->grown += arenas[i].rs.grown;
+		stats->extended += arenas[i].rs.extended;
+		stats->moved += arenas[i].rs.moved;
+		stats->bytes_copied += arenas[i].rs.bytes_copied;
+		stats->remapped += arenas[i].rs.remapped;
+	}
+}
+
+/*
+ * mm_stats: sum the heap layout counters of all arenas, and walk their
+ * free lists (not the heap) for the free blocks of each class. The
+ * overhead is a header word per block in use and per mapped block's
+ * MAP_HDR, plus each arena's prologue and each segment's padding and
+ * epilogue words.
+ */
+void mm_stats(mm_stats_t *stats){
+	int n = __atomic_load_n(&arena_num, __ATOMIC_ACQUIRE);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->heap_bytes = mem_heapsize();
+	stats->mapped_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+	stats->mapped_blocks = __atomic_load_n(&mapped_blocks, __ATOMIC_RELAXED);
+	for(int i = 0; i < n; i++){
+		arena_t *a = &arenas[i];
+
+		for(int j = 0; j < LIST_NUM; j++){
+			char *head = a->lists + j * DSIZE;
+
+			for(char *bp = NEXT_FREE_BLKP(head); bp != head;
+			 bp = NEXT_FREE_BLKP(bp)){
+				stats_block(stats, GET_SIZE(HDRP(bp)));
+			}
+		}
+#ifdef TREE_LIST
+		stats_tree(stats, a->tree);
+#endif
+		stats->alloc_blocks += a->alloc_blocks;
+		stats->splits += a->splits;
+		stats->coalesces += a->coalesces;
+	}
+	stats->overhead_bytes = stats->alloc_blocks * ALLOC_OVERHEAD +
+	 stats->mapped_blocks * MAP_HDR +
+	 n * (LIST_NUM * DSIZE + 2 * WSIZE) +
+	 __atomic_load_n(&seg_num, __ATOMIC_ACQUIRE) * DSIZE;
+	if(stats->total_free_bytes > 0){
+		stats->ext_frag = 1.0 -
+		 (double)stats->largest_free / stats->total_free_bytes;
+	}
+}
+
+/* stats_block: count a free block of size bytes */
+static void stats_block(mm_stats_t *stats, size_t size){
+	stats->free_blocks[STATS_CLASS(size)]++;
+	stats->free_bytes[STATS_CLASS(size)] += size;
+	stats->total_free_blocks++;
+	stats->total_free_bytes += size;
+	stats->largest_free = MAX(stats->largest_free, size);
+}
+
+#ifdef TREE_LIST
+/* stats_tree: count the free blocks of the subtree at offset ofs */
+static void stats_tree(mm_stats_t *stats, unsigned int ofs){
+	if(ofs == 0){
+		return;
+	}
+	stats_block(stats, GET_SIZE(HDRP(OFS_PTR(ofs))));
+	stats_tree(stats, *LEFT_OFS(OFS_PTR(ofs)));
+	stats_tree(stats, *RIGHT_OFS(OFS_PTR(ofs)));
+}
+#endif
+
+/*******************************
+ 	   	slab functions
+ ******************************/
+
+/* is_slab: whether bp is an object of a slab run */
+static inline int is_slab(void *bp){
+	size_t i = PAGE_INDEX(bp);
+
+	return (__atomic_load_n(&slab_pages[i / 8], __ATOMIC_RELAXED) >> (i % 8)) & 1;
+}
+
+/* slab_alloc: take the first free slot of the arena's first run of the
+ * size's class, start a new run if there is none. Caller holds the arena.
+ */
+static void *slab_alloc(size_t size){
+	size_t c = SLAB_CLASS(size);
+	slab_run_t *run;
+	size_t i, bit;
+
+	if(arena->slab[c] == 0 && new_run(c) == NULL){
+		return NULL;
+	}
+	run = (slab_run_t *)OFS_PTR(arena->slab[c]);
+
+	for(i = 0; run->map[i] == ~0ULL; i++)
+		;
+	bit = __builtin_ctzll(~run->map[i]);
+	run->map[i] |= 1ULL << bit;
+	mark_block(run);
+
+	//full run leaves the list
+	if(++run->used == run->slots){
+		arena->slab[c] = run->next;
+		if(run->next){
+			((slab_run_t *)OFS_PTR(run->next))->prev = 0;
+		}
+	}
+	return (char *)(run + 1) + (i * 64 + bit) * run->size;
+}
+
+/* slab_free: clear the slot of bp in its run. A run that was full goes
+ * back to the list, an empty run is released unless it is the only one
+ * of its class. Caller holds the arena.
+ */
+static void slab_free(void *bp){
+	slab_run_t *run = RUN_OF(bp);
+	size_t c = SLAB_CLASS(run->size);
+	unsigned int ofs = TO_OFS(run);
+	size_t slot = ((char *)bp - (char *)(run + 1)) / run->size;
+
+	run->map[slot / 64] &= ~(1ULL << (slot % 64));
+	mark_block(run);
+
+	if(run->used-- == run->slots){
+		run->prev = 0;
+		run->next = arena->slab[c];
+		if(run->next){
+			((slab_run_t *)OFS_PTR(run->next))->prev = ofs;
+		}
+		arena->slab[c] = ofs;
+	}
+	if(run->used == 0 && (run->next || run->prev)){
+		release_run(run);
+	}
+}
+
+/* run_front: bytes from bp to the first page boundary that leaves 0 or
+ * a free block in front of it */
+static inline size_t run_front(void *bp){
+	size_t front = (RUN_SIZE - ((char *)bp - base_ptr) % RUN_SIZE) % RUN_SIZE;
+
+	if(front > 0 && front < MIN_FREE_SIZE){
+		front += RUN_SIZE;
+	}
+	return front;
+}
+
+/*
+ * new_run: carve a page aligned run out of a free block of the arena and
+ * put it on the list of class c. A free block needs room for the run
+ * wherever it starts, what is left around the run stays free. If there
+ * is none, the heap grows just up to the end of the next aligned run.
+ */
+static slab_run_t *new_run(size_t c){
+	size_t need = 2 * RUN_SIZE + MIN_FREE_SIZE;
+	size_t csize, front, back, is_prev_alloc, i;
+	char *bp, *run;
+	slab_run_t *r;
+
+	if((bp = find_fit(need)) == NULL){
+		//where the block made by extend_heap would start
+		bp = arena->epilogue + WSIZE;
+		if(!GET_PREV_ALLOC(arena->epilogue)){
+			bp -= GET_SIZE(arena->epilogue - WSIZE);
+		}
+		need = run_front(bp) + RUN_SIZE;
+		if((bp = extend_heap(need / WSIZE)) == NULL){
+			return NULL;
+		}
+		//another arena took the top meanwhile, grow again
+		if(GET_SIZE(HDRP(bp)) < run_front(bp) + RUN_SIZE &&
+		 (bp = extend_heap((2 * RUN_SIZE + MIN_FREE_SIZE) / WSIZE)) == NULL){
+			return NULL;
+		}
+	}
+	csize = GET_SIZE(HDRP(bp));
+	is_prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+	delete(bp);
+
+	front = run_front(bp);
+	run = (char *)bp + front;
+	back = csize - front - RUN_SIZE;
+	if(back < MIN_FREE_SIZE){
+		back = 0;
+	}
+
+	if(front){
+		PUT(HDRP(bp), PACK(front, is_prev_alloc, 0));
+		PUT(FTRP(bp), PACK(front, 0, 0));
+		insert(bp, front);
+		mark_block(bp);
+		is_prev_alloc = 0;
+	}
+	PUT(HDRP(run), PACK(csize - front - back, is_prev_alloc, 1));
+	mark_block(run);
+	use_fresh(run + csize - front - back);
+	arena->alloc_blocks++;
+	arena->splits += (front > 0) + (back > 0);
+	if(back){
+		//the block after it already knows its prev block is free
+		bp = NEXT_BLKP(run);
+		PUT(HDRP(bp), PACK(back, 2, 0));
+		PUT(FTRP(bp), PACK(back, 0, 0));
+		insert(bp, back);
+		mark_block(bp);
+	}else{
+		SET_PREV_ALLOC(HDRP(NEXT_BLKP(run)));
+	}
+
+	//the run's header word is in the page before, the next block's
+	//header is in the last word of the run
+	r = (slab_run_t *)run;
+	r->size = SLAB_SIZE(c);
+	r->used = 0;
+	r->slots = (RUN_SIZE - WSIZE - sizeof(slab_run_t)) / r->size;
+	memset(r->map, 0, sizeof(r->map));
+	for(i = r->slots; i < 8 * sizeof(r->map); i++){
+		r->map[i / 64] |= 1ULL << (i % 64);
+	}
+	r->prev = 0;
+	r->next = arena->slab[c];
+	if(r->next){
+		((slab_run_t *)OFS_PTR(r->next))->prev = TO_OFS(run);
+	}
+	arena->slab[c] = TO_OFS(run);
+
+	i = PAGE_INDEX(run);
+	__atomic_fetch_or(&slab_pages[i / 8], 1 << (i % 8), __ATOMIC_RELAXED);
+	pthread_mutex_lock(&heap_lock);
+	slab_pages_hi = MAX(slab_pages_hi, i / 8 + 1);
+	pthread_mutex_unlock(&heap_lock);
+	return r;
+}
+
+/* release_run: take an empty run off its list and free its block */
+static void release_run(slab_run_t *run){
+	size_t c = SLAB_CLASS(run->size);
+	size_t i = PAGE_INDEX(run);
+
+	if(run->prev){
+		((slab_run_t *)OFS_PTR(run->prev))->next = run->next;
+	}else{
+		arena->slab[c] = run->next;
+	}
+	if(run->next){
+		((slab_run_t *)OFS_PTR(run->next))->prev = run->prev;
+	}
+	__atomic_fetch_and(&slab_pages[i / 8], ~(1 << (i % 8)), __ATOMIC_RELAXED);
+	free_block(run);
+}
+
+/*******************************
+ 	   	mapped block functions
+ ******************************/
+
+/*
+ * map_alloc: give a request of size bytes its own mapping. Return NULL
+ * if there is no memory, or if the mapping lands in the heap's offset
+ * range, the caller then takes it from the heap.
+ */
+static void *map_alloc(size_t size){
+	size_t page = mem_pagesize();
+	size_t len = ALIGN_UP(size + MAP_HDR, page);
+	char *m;
+
+	//the round up to pages wraps
+	if(size > SIZE_MAX - MAP_HDR - page){
+		return NULL;
+	}
+	if((m = mem_mmap(len)) == NULL){
+		return NULL;
+	}
+	if(!IS_MAPPED(m + MAP_HDR)){
+		mem_munmap(m);
+		return NULL;
+	}
+	*(size_t *)m = len;
+	__atomic_add_fetch(&mapped_bytes, len, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&mapped_blocks, 1, __ATOMIC_RELAXED);
+	return m + MAP_HDR;
+}
+
+/*
+ * map_free: unmap the mapped block bp. A block bigger than the threshold
+ * that is freed was not long lived, map fewer of them.
+ */
+static void map_free(void *bp){
+	size_t len = MAP_LEN(bp);
+
+	if(__atomic_load_n(&mmap_dynamic, __ATOMIC_RELAXED) &&
+	 len > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+	 len <= MAX_MMAP_THRESHOLD){
+		__atomic_store_n(&mmap_threshold, len, __ATOMIC_RELAXED);
+		if(2 * len > __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED)){
+			__atomic_store_n(&trim_threshold, 2 * len, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_sub_fetch(&mapped_bytes, len, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&mapped_blocks, 1, __ATOMIC_RELAXED);
+	mem_munmap((char *)bp - MAP_HDR);
+}
+
+/*
+ * map_realloc: resize the mapped block bp to size bytes with mremap, the
+ * kernel moves the pages if it has to. It stays mapped however small it
+ * gets, like in glibc. Return NULL and leave bp alone on failure.
+ */
+static void *map_realloc(void *bp, size_t size){
+	size_t page = mem_pagesize();
+	size_t len = MAP_LEN(bp);
+	size_t newlen = ALIGN_UP(size + MAP_HDR, page);
+	char *m;
+
+	if(size > SIZE_MAX - MAP_HDR - page){
+		return NULL;
+	}
+	if(newlen == len){
+		return bp;
+	}
+	if((m = mem_mremap((char *)bp - MAP_HDR, newlen)) == NULL){
+		return NULL;
+	}
+	*(size_t *)m = newlen;
+	__atomic_add_fetch(&mapped_bytes, newlen - len, __ATOMIC_RELAXED);
+	if(enter_arena() != NULL){
+		arena->rs.remapped++;
+		leave_arena();
+	}
+	return m + MAP_HDR;
+}
+
+/*
+ * mm_set_mmap_threshold: map requests of size bytes or more directly from
+ * now on, and stop adapting the threshold. 0 turns the mapping off.
+ */
+void mm_set_mmap_threshold(size_t size){
+	__atomic_store_n(&mmap_dynamic, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&mmap_threshold, size > 0 ? size : SIZE_MAX,
+	 __ATOMIC_RELAXED);
+}
+
+/*
+ * mm_set_growth: grow the heap adaptively, by steps of up to cap bytes,
+ * or by CHUNKSIZE chunks again if cap is 0
+ */
+void mm_set_growth(size_t cap){
+	grow_cap = cap;
+}
+
+/*
+ * mm_set_list_order: make the seglists of each class c whose bit is set
+ * in classes address ordered, the rest LIFO. Lists can't change order
+ * with blocks on them, so it takes effect at the next mm_init.
+ */
+void mm_set_list_order(unsigned int classes){
+	ao_classes_next = classes;
+}
+
+/*
+ * mm_set_slab: turn slab mode for requests of up to SLAB_MAX_SIZE bytes
+ * on or off. Objects already in runs are freed to them either way.
+ */
+void mm_set_slab(int on){
+	slab_on = on;
+}
+
+/*******************************
+ 	   	region functions
+ ******************************/
+
+/*
+ * mm_arena_create: start a region with one chunk, which holds the region
+ * itself besides the first objects. Return NULL if there is no memory.
+ */
+mm_arena_t *mm_arena_create(void){
+	char *chunk;
+	mm_arena_t *a;
+
+	if((chunk = do_malloc(REGION_CHUNK)) == NULL){
+		return NULL;
+	}
+	*(char **)chunk = NULL;
+	a = (mm_arena_t *)(chunk + REGION_HDR);
+	a->chunks = chunk;
+	a->cur = (char *)a + ALIGN(sizeof(*a));
+	a->end = chunk + REGION_CHUNK;
+	a->chunk_size = 2 * REGION_CHUNK;
+	return a;
+}
+
+/*
+ * mm_arena_alloc: bump size bytes off the region's chunk, and take a new
+ * chunk from the heap if it is used up
+ */
+void *mm_arena_alloc(mm_arena_t *a, size_t size){
+	char *bp;
+
+	if(size == 0 || size > SIZE_MAX / 2){
+		return NULL;
+	}
+	size = ALIGN(size);
+	if(__builtin_expect(size > (size_t)(a->end - a->cur), 0)){
+		return region_chunk(a, size);
+	}
+	bp = a->cur;
+	a->cur += size;
+	return bp;
+}
+
+/*
+ * region_chunk: add a chunk to region a and take size bytes from it. An
+ * object bigger than a quarter chunk gets a chunk of its own, and the
+ * region keeps bumping through the one it has. Otherwise the rest of
+ * that is left, and the next chunk is twice as big, up to
+ * REGION_MAX_CHUNK.
+ */
+static void *region_chunk(mm_arena_t *a, size_t size){
+	size_t csize = size > a->chunk_size / 4 ? size + REGION_HDR : a->chunk_size;
+	char *chunk;
+
+	if((chunk = do_malloc(csize)) == NULL){
+		return NULL;
+	}
+	*(char **)chunk = a->chunks;
+	a->chunks = chunk;
+	if(csize == a->chunk_size){
+		a->cur = chunk + REGION_HDR + size;
+		a->end = chunk + csize;
+		a->chunk_size = MIN(2 * a->chunk_size, REGION_MAX_CHUNK);
+	}
+	return chunk + REGION_HDR;
+}
+
+/*
+ * mm_arena_destroy: free every chunk of region a, its objects with them.
+ * The region lives in the oldest chunk, which goes last.
+ */
+void mm_arena_destroy(mm_arena_t *a){
+	char *chunk = a->chunks;
+	char *next;
+
+	while(chunk != NULL){
+		next = *(char **)chunk;
+		do_free(chunk);
+		chunk = next;
+	}
+}
+
+/*******************************
+ 	   	profiler functions
+ ******************************/
+
+/* prof_now: monotonic time in ns */
+static unsigned long long prof_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * prof_interval: bytes to allocate before the next sample, uniform in
+ * [1, 2 * prof_rate] so samples don't lock step with a periodic pattern
+ */
+static long prof_interval(void){
+	size_t rate = __atomic_load_n(&prof_rate, __ATOMIC_RELAXED);
+
+	if(rate == 0){
+		return LONG_MAX;
+	}
+	if(prof_seed == 0){
+		prof_seed = (uintptr_t)&prof_seed ^ prof_now();
+	}
+	prof_seed ^= prof_seed << 13;
+	prof_seed ^= prof_seed >> 7;
+	prof_seed ^= prof_seed << 17;
+	return 1 + prof_seed % (2 * rate);
+}
+
+/*
+ * prof_malloc: count size bytes against the thread's budget, and sample
+ * the new block bp once it runs out
+ */
+static __attribute__((noinline)) void prof_malloc(void *bp, size_t size){
+	if(prof_seed == 0){
+		prof_left = prof_interval();
+	}
+	if((prof_left -= (long)size) > 0){
+		return;
+	}
+	prof_left = prof_interval();
+	if(prof_busy){
+		return;
+	}
+	prof_busy = 1;
+	prof_sample(bp, size);
+	prof_busy = 0;
+}
+
+/*
+ * prof_find_site: slot of the site with this backtrace and tag, added
+ * if new, -1 if the table is full. Caller holds prof_lock.
+ */
+static int prof_find_site(void **pc, int depth, long tag){
+	unsigned long long h = tag;
+	size_t i;
+
+	for(int k = 0; k < depth; k++){
+		h = (h ^ (uintptr_t)pc[k]) * 0x100000001b3ULL;
+	}
+	for(i = h & (PROF_SITES - 1); prof_sites[i].depth != 0;
+	 i = (i + 1) & (PROF_SITES - 1)){
+		if(prof_sites[i].depth == depth && prof_sites[i].tag == tag &&
+		 memcmp(prof_sites[i].pc, pc, depth * sizeof(*pc)) == 0){
+			return i;
+		}
+	}
+	if(prof_site_num >= PROF_SITES * 3 / 4){
+		return -1;
+	}
+	prof_site_num++;
+	memset(&prof_sites[i], 0, sizeof(prof_sites[i]));
+	memcpy(prof_sites[i].pc, pc, depth * sizeof(*pc));
+	prof_sites[i].depth = depth;
+	prof_sites[i].tag = tag;
+	return i;
+}
+
+/*
+ * prof_sample: record the block bp of size bytes as a sample of its
+ * site. A sample of a block smaller than prof_rate stands for the
+ * prof_rate / size blocks like it that weren't sampled.
+ */
+static __attribute__((noinline)) void prof_sample(void *bp, size_t size){
+	void *pc[PROF_DEPTH + 1];
+	int depth, site;
+	unsigned long blocks;
+	size_t i;
+
+	//backtrace() may allocate, before the lock. Frame 0 is this one
+	depth = backtrace(pc, PROF_DEPTH + 1) - 1;
+	if(depth < 1){
+		return;
+	}
+	blocks = size >= prof_rate ? 1 : (prof_rate + size / 2) / size;
+
+	pthread_mutex_lock(&prof_lock);
+	if(prof_live_num >= PROF_LIVE * 3 / 4 ||
+	 (site = prof_find_site(pc + 1, depth, prof_tag)) < 0){
+		prof_dropped++;
+		pthread_mutex_unlock(&prof_lock);
+		return;
+	}
+	for(i = PROF_HASH(bp) & (PROF_LIVE - 1); prof_live[i].ptr != NULL;
+	 i = (i + 1) & (PROF_LIVE - 1))
+		;
+	prof_live[i].ptr = bp;
+	prof_live[i].site = site;
+	prof_live[i].blocks = blocks;
+	prof_live[i].bytes = blocks * size;
+	prof_live[i].tag = prof_tag;
+	prof_live[i].born = prof_now();
+	prof_sites[site].live_blocks += blocks;
+	prof_sites[site].live_bytes += blocks * size;
+	prof_sites[site].alloc_blocks += blocks;
+	prof_sites[site].alloc_bytes += blocks * size;
+	__atomic_add_fetch(&prof_filter[PROF_HASH(bp) & (PROF_FILTER - 1)], 1,
+	 __ATOMIC_RELAXED);
+	__atomic_add_fetch(&prof_live_num, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&prof_lock);
+}
+
+/*
+ * prof_free: drop the sample of bp, if it has one, and add its lifetime
+ * to its site. Called before bp is freed, so no other thread can have
+ * sampled the same address meanwhile.
+ */
+static void prof_free(void *bp){
+	size_t i, j, k;
+	prof_sample_t *s;
+	prof_site_t *site;
+
+	if(prof_busy || __atomic_load_n(&prof_filter[PROF_HASH(bp) &
+	 (PROF_FILTER - 1)], __ATOMIC_RELAXED) == 0){
+		return;
+	}
+	pthread_mutex_lock(&prof_lock);
+	for(i = PROF_HASH(bp) & (PROF_LIVE - 1); prof_live[i].ptr != bp;
+	 i = (i + 1) & (PROF_LIVE - 1)){
+		if(prof_live[i].ptr == NULL){
+			pthread_mutex_unlock(&prof_lock);
+			return;
+		}
+	}
+	s = &prof_live[i];
+	site = &prof_sites[s->site];
+	site->live_blocks -= s->blocks;
+	site->live_bytes -= s->bytes;
+	site->freed += s->blocks;
+	site->life_ns += (double)(prof_now() - s->born) * s->blocks;
+	if(s->tag >= 0 && prof_tag >= 0){
+		site->tagged += s->blocks;
+		site->life_tags += (double)(prof_tag - s->tag) * s->blocks;
+	}
+	__atomic_sub_fetch(&prof_filter[PROF_HASH(bp) & (PROF_FILTER - 1)], 1,
+	 __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&prof_live_num, 1, __ATOMIC_RELAXED);
+
+	//backward shift: move up the later samples that probed past slot i
+	for(j = (i + 1) & (PROF_LIVE - 1); prof_live[j].ptr != NULL;
+	 j = (j + 1) & (PROF_LIVE - 1)){
+		k = PROF_HASH(prof_live[j].ptr) & (PROF_LIVE - 1);
+		if(((j - k) & (PROF_LIVE - 1)) >= ((j - i) & (PROF_LIVE - 1))){
+			prof_live[i] = prof_live[j];
+			i = j;
+		}
+	}
+	prof_live[i].ptr = NULL;
+	pthread_mutex_unlock(&prof_lock);
+}
+
+/* prof_reset: drop every site and sample, the heap they were in is gone */
+static void prof_reset(void){
+	//nothing was sampled, the tables are clear already
+	if(prof_site_num == 0 && prof_dropped == 0){
+		return;
+	}
+	pthread_mutex_lock(&prof_lock);
+	memset(prof_sites, 0, sizeof(prof_sites));
+	prof_site_num = 0;
+	memset(prof_live, 0, sizeof(prof_live));
+	memset(prof_filter, 0, sizeof(prof_filter));
+	__atomic_store_n(&prof_live_num, 0, __ATOMIC_RELAXED);
+	prof_dropped = 0;
+	pthread_mutex_unlock(&prof_lock);
+}
+
+/*
+ * mm_set_profile: sample about one allocation per rate bytes from now on,
+ * 0 stops sampling. What was sampled stays until the next mm_init.
+ */
+void mm_set_profile(size_t rate){
+	__atomic_store_n(&prof_rate, rate, __ATOMIC_RELAXED);
+}
+
+/* mm_profile_tag: tag the calling thread's next samples and frees */
+void mm_profile_tag(long tag){
+	prof_tag = tag;
+}
+
+/* prof_cmp: qsort order of site slots, most live bytes first */
+static int prof_cmp(const void *a, const void *b){
+	const prof_site_t *x = &prof_sites[*(const int *)a];
+	const prof_site_t *y = &prof_sites[*(const int *)b];
+
+	if(x->live_bytes != y->live_bytes){
+		return x->live_bytes < y->live_bytes ? 1 : -1;
+	}
+	if(x->alloc_bytes != y->alloc_bytes){
+		return x->alloc_bytes < y->alloc_bytes ? 1 : -1;
+	}
+	return x->tag < y->tag ? -1 : x->tag > y->tag;
+}
+
+/*
+ * mm_profile_dump: write the sites to out, as flat text with a line per
+ * site, or as a pprof heap profile (the text format of gperftools, with
+ * this process's mappings so pprof can symbolize it). Return the number
+ * of sites written.
+ */
+int mm_profile_dump(FILE *out, int format){
+	static int order[PROF_SITES];
+	unsigned long live_blocks = 0, alloc_blocks = 0;
+	size_t live_bytes = 0, alloc_bytes = 0;
+	char buf[4096];
+	int n = 0, fd;
+	ssize_t len;
+
+	//stdio may allocate, nothing is sampled meanwhile
+	prof_busy = 1;
+	pthread_mutex_lock(&prof_lock);
+	for(int i = 0; i < PROF_SITES; i++){
+		if(prof_sites[i].depth != 0){
+			order[n++] = i;
+			live_blocks += prof_sites[i].live_blocks;
+			live_bytes += prof_sites[i].live_bytes;
+			alloc_blocks += prof_sites[i].alloc_blocks;
+			alloc_bytes += prof_sites[i].alloc_bytes;
+		}
+	}
+	qsort(order, n, sizeof(*order), prof_cmp);
+
+	if(format == MM_PROF_PPROF){
+		fprintf(out, "heap profile: %lu: %zu [%lu: %zu] @ heap_v2/%zu\n",
+		 live_blocks, live_bytes, alloc_blocks, alloc_bytes, prof_rate);
+	}else{
+		fprintf(out, "# 1 sample per ~%zu bytes, %d sites, %lu samples "
+		 "dropped\n# live: %zu bytes in %lu blocks, allocated: %zu bytes "
+		 "in %lu blocks\n", prof_rate, n, prof_dropped, live_bytes,
+		 live_blocks, alloc_bytes, alloc_blocks);
+		fprintf(out, "# live_bytes live_blocks alloc_bytes alloc_blocks "
+		 "freed life_us life_tags tag @ backtrace\n");
+	}
+	for(int i = 0; i < n; i++){
+		prof_site_t *site = &prof_sites[order[i]];
+
+		if(format == MM_PROF_PPROF){
+			fprintf(out, "%lu: %zu [%lu: %zu] @", site->live_blocks,
+			 site->live_bytes, site->alloc_blocks, site->alloc_bytes);
+		}else{
+			fprintf(out, "%zu %lu %zu %lu %lu ", site->live_bytes,
+			 site->live_blocks, site->alloc_bytes, site->alloc_blocks,
+			 site->freed);
+			if(site->freed > 0){
+				fprintf(out, "%.1f ", site->life_ns / site->freed / 1000);
+			}else{
+				fprintf(out, "- ");
+			}
+			if(site->tagged > 0){
+				fprintf(out, "%.1f ", site->life_tags / site->tagged);
+			}else{
+				fprintf(out, "- ");
+			}
+			fprintf(out, "%ld @", site->tag);
+		}
+		for(int k = 0; k < site->depth; k++){
+			fprintf(out, " %p", site->pc[k]);
+		}
+		fprintf(out, "\n");
+	}
+	pthread_mutex_unlock(&prof_lock);
+
+	if(format == MM_PROF_PPROF){
+		fprintf(out, "\nMAPPED_LIBRARIES:\n");
+		if((fd = open("/proc/self/maps", O_RDONLY)) >= 0){
+			while((len = read(fd, buf, sizeof(buf))) > 0){
+				fwrite(buf, 1, len, out);
+			}
+			close(fd);
+		}
+	}
+	prof_busy = 0;
+	return n;
+}
+
+/*******************************
+ 	   	check funcitons
+ ******************************/
+
+/*
+ * mm_set_check: pick what mm_checkheap checks from the next mm_init on,
+ * the whole heap, the blocks changed since the last check, or the
+ * blocks starting in a random window of window bytes (0: CHECK_WINDOW)
+ */
+void mm_set_check(int mode, size_t window){
+	pthread_mutex_lock(&heap_lock);
+	check_mode_next = mode;
+	check_window = window > 0 ? window : CHECK_WINDOW;
+	pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * mm_checkheap: check as much of the heap as the mode of mm_set_check
+ * says. Only the full walk prints the heap if verbose, the cheaper
+ * modes print nothing but errors.
+ */
+void mm_checkheap(int verbose) {
+	if(check_mode == MM_CHECK_INCREMENTAL){
+		check_dirty();
+	}else if(check_mode == MM_CHECK_SAMPLE){
+		check_sample();
+	}else{
+		check_heap(verbose);
+	}
+	dirty_num = 0;
+}
+
+/* mark_block: bp starts a block that changed */
+static inline void mark_block(void *bp){
+	size_t i;
+	unsigned long n;
+
+	if(__builtin_expect(check_mode == MM_CHECK_FULL, 1)){
+		return;
+	}
+	i = START_BIT(bp);
+	__atomic_fetch_or(&starts[i / 8], 1 << (i % 8), __ATOMIC_RELAXED);
+	if(check_mode == MM_CHECK_INCREMENTAL){
+		n = __atomic_fetch_add(&dirty_num, 1, __ATOMIC_RELAXED);
+		if(n < DIRTY_LOG_SIZE){
+			dirty_log[n] = TO_OFS(bp);
+		}
+	}
+}
+
+/* unmark_block: bp no longer starts a block */
+static inline void unmark_block(void *bp){
+	size_t i;
+
+	if(__builtin_expect(check_mode != MM_CHECK_FULL, 0)){
+		i = START_BIT(bp);
+		__atomic_fetch_and(&starts[i / 8], ~(1 << (i % 8)), __ATOMIC_RELAXED);
+	}
+}
+
+/* next_start: first bit from i on set in the block start bitmap, or end */
+static size_t next_start(size_t i, size_t end){
+	while(i < end){
+		if(i % 8 == 0 && starts[i / 8] == 0){
+			i += 8;
+		}else if(IS_START(i)){
+			return i;
+		}else{
+			i++;
+		}
+	}
+	return end;
+}
+
+/*
+ * check_dirty: check the blocks logged since the last check that still
+ * start a block, or the whole heap if there were too many
+ */
+static void check_dirty(void){
+	unsigned long n = dirty_num;
+	size_t end = mem_heapsize() / DSIZE;
+
+	if(n > DIRTY_LOG_SIZE){
+		check_heap(0);
+		return;
+	}
+	for(unsigned long i = 0; i < n; i++){
+		char *bp = OFS_PTR(dirty_log[i]);
+		size_t bit = START_BIT(bp);
+
+		if(bit < end && IS_START(bit)){
+			check_local(bp);
+		}
+	}
+	if(arena_epoch == mm_epoch){
+		check_tcache();
+	}
+}
+
+/*
+ * check_sample: check the blocks starting in a window of check_window
+ * bytes at a random place of the heap
+ */
+static void check_sample(void){
+	static unsigned long long seed = 88172645463325252ULL;
+	size_t bits = mem_heapsize() / DSIZE;
+	size_t window = check_window / DSIZE;
+	size_t i, end;
+
+	//xorshift, the heap is walked the same way in every run
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	i = bits > window ? (seed % (bits - window)) & ~(size_t)7 : 0;
+	end = MIN(i + window, bits);
+	for(i = next_start(i, end); i < end; i = next_start(i + 1, end)){
+		check_local(base_ptr + i * DSIZE);
+	}
+	if(arena_epoch == mm_epoch){
+		check_tcache();
+	}
+}
+
+/*
+ * check_local: check the block bp alone, with checkblock, against the
+ * block start bitmap and against the links of its neighbours in the
+ * heap and, if it is free, in its free list or the size tree
+ */
+static void check_local(char *bp){
+	size_t size = GET_SIZE(HDRP(bp));
+	char *next = bp + size;
+
+	if(size < MIN_FREE_SIZE || next > (char *)mem_heap_hi() + 1){
+		printf("Error: block @ [%p] has size [%d], past the heap top\n",
+		 bp, (int)size);
+		return;
+	}
+	checkblock(bp);
+
+	//no block starts inside, the next one starts right after
+	if(next_start(START_BIT(bp) + 1, START_BIT(next)) != START_BIT(next) ||
+	 (GET_SIZE(HDRP(next)) > 0 && !IS_START(START_BIT(next)))){
+		printf("Error: block @ [%p] overlaps a block or isn't followed \
+			by one\n", bp);
+	}
+	if(!GET_PREV_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp) - WSIZE) == 0 ||
+	 !IS_START(START_BIT(PREV_BLKP(bp))) || GET_ALLOC(HDRP(PREV_BLKP(bp))))){
+		printf("Error: block @ [%p] has no free block before it\n", bp);
+	}
+
+	if(GET_ALLOC(HDRP(bp))){
+		if(is_slab(bp)){
+			check_run((slab_run_t *)bp);
+		}
+		return;
+	}
+#ifdef TREE_LIST
+	if(size >= TREE_MIN_SIZE){
+		unsigned int ofs = TO_OFS(bp);
+		char *left = OFS_PTR(*LEFT_OFS(bp));
+		char *right = OFS_PTR(*RIGHT_OFS(bp));
+
+		if((*LEFT_OFS(bp) && (!tree_less(left, GET_SIZE(HDRP(left)), bp) ||
+		 TREE_PRIO(*LEFT_OFS(bp)) >= TREE_PRIO(ofs))) ||
+		 (*RIGHT_OFS(bp) && (!tree_less(bp, size, right) ||
+		 TREE_PRIO(*RIGHT_OFS(bp)) >= TREE_PRIO(ofs)))){
+			printf("Error: size tree node @ [%p] has children out of \
+				order\n", bp);
+		}
+		return;
+	}
+#endif
+	if(PREV_FREE_BLKP(NEXT_FREE_BLKP(bp)) != bp ||
+	 NEXT_FREE_BLKP(PREV_FREE_BLKP(bp)) != bp){
+		printf("Error: block @ [%p]: its free list neighbours don't point \
+			back to it\n", bp);
+	}
+}
+
+/*
+ * check_heap: 
+ * walk every segment, then every arena's free lists
+ */
+static void check_heap(int verbose) {
+
+	int fblock_counter[MAX_ARENAS] = {0};
+	unsigned long ablocks[MAX_ARENAS] = {0};
+
+	if(verbose){
+		printf("Heap starts @ [%p], %d arenas, %d segments\n", base_ptr,
+		 arena_num, seg_num);
+		printf("----------------------------------\n");
+	}
+	/*check the szie of the heap*/
+	if(mem_heapsize() > MAX_HEAP_SIZE){
+		printf("Error: Heap size [%d] bytes, violate heap size limitation\n",
+		 (int)mem_heapsize());
+	}
+
+	//mapped blocks are all the mappings there are
+	if(__atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED) != mem_mapped()){
+		printf("Error: mapped blocks hold [%zu] bytes, mappings [%zu]\n",
+		 __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED), mem_mapped());
+	}
+
+	//check segments
+	for(int i = 0; i < seg_num; i++){
+		if(segs[i].lo != (i == 0 ? (char *)mem_heap_lo() : segs[i - 1].hi)){
+			printf("Error: segment %d @ [%p] is not adjacent to the \
+				previous one\n", i, segs[i].lo);
+		}
+		fblock_counter[segs[i].arena - arenas] +=
+		 check_segment(&segs[i], verbose, &ablocks[segs[i].arena - arenas]);
+	}
+	if(seg_num > 0 && segs[seg_num - 1].hi != (char *)mem_heap_hi() + 1){
+		printf("%s\n", "Error: last segment doesn't end at the heap top");
+	}
+
+	//check free lists of each arena
+	for(int i = 0; i < arena_num; i++){
+		int fblock_list = check_free_list(&arenas[i]);
+
+		if(fblock_counter[i] != fblock_list){
+			printf("Error: free block number from check \
+				heap and check free list doesn't match\n");
+			printf("arena: [%d]\n", i);
+			printf("heap free block num: [%d]\n", fblock_counter[i]);
+			printf("free list free block num: [%d]\n", fblock_list);
+		}
+
+		//the mm_stats counter must match the heap
+		if(arenas[i].alloc_blocks != ablocks[i]){
+			printf("Error: arena %d counts %lu blocks in use, the heap \
+				has %lu\n", i, arenas[i].alloc_blocks, ablocks[i]);
+		}
+
+		if(verbose){
+			printf("Arena %d\n", i);
+			printf("Free block number counted in heap: %d\n",
+			 fblock_counter[i]);
+			printf("Free block number counted in free list: %d\n",
+			 fblock_list);
+			printf("----------------------------------\n");
+		}
+	}
+
+	for(int i = 0; i < arena_num; i++){
+		check_quick(&arenas[i]);
+	}
+	if(arena_epoch == mm_epoch){
+		check_tcache();
+	}
+}
+
+/*
+ * check_segment: check one segment's padding, prologue (if it is the
+ * first segment of its arena), blocks and epilogue. Add its blocks in
+ * use to alloc_blocks. Return the number of free blocks in it.
+ */
+static int check_segment(seg_t *s, int verbose, unsigned long *alloc_blocks){
+
+	char *bp = s->lo + DSIZE;
+	char *epilogue_ptr = s->hi - WSIZE;
+	size_t prologue_size = LIST_NUM * DSIZE + 2 * WSIZE;
+
+	/*check first word of the segment, it should be 0 padding*/
+	if((GET(s->lo) != 0)){
+		printf("%s\n","Error: first word should be 0 padding");
+	}
+
+	/* check prologue */
+	if(bp == s->arena->lists){
+		if((GET_SIZE(HDRP(bp)) != prologue_size) || (GET_ALLOC(HDRP(bp)) != 1) 
+			|| (GET_PREV_ALLOC(HDRP(bp)) != 2)){
+			printf("%s\n", "Error: invalid prologue");
+		}
+		if(GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))){
+			printf("%s\n", "Error: prologue sizes in \
+				header and footer do not match");
+		}
+		if(GET_ALLOC(HDRP(bp)) != GET_ALLOC(FTRP(bp))){
+			printf("%s\n", "Error: allocated bit in \
+				header and footer do not match");
+		}
+
+		if(verbose){
+			printf("prologue @ [%p], prologue size is %d\n", 
+				bp, (int)prologue_size);
+			printf("----------------------------------\n");
+		}
+		bp = NEXT_BLKP(bp);
+	}else if(GET_PREV_ALLOC(HDRP(bp)) != 2){
+		printf("Error: first block @ [%p] of segment has a free \
+			prev block\n", bp);
+	}
+
+	/* check epilogue */
 	if(GET_ALLOC(epilogue_ptr) != 1 || GET_SIZE(epilogue_ptr) != 0){
 		printf("%s\n", "Error: invalid epilogue");
 	}
@@ -555,8 +3218,18 @@ void mm_checkheap(int verbose) {
 
 	//check heap
 	int fblock_counter = 0;
+	size_t start = START_BIT(s->lo);
+
+	for(; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+		//the bitmap has the block and nothing since the last one
+		if(check_mode != MM_CHECK_FULL){
+			if(next_start(start, START_BIT(s->hi)) != START_BIT(bp)){
+				printf("Error: block start bitmap is wrong before \
+					block @ [%p]\n", bp);
+			}
+			start = START_BIT(bp) + 1;
+		}
 
-	for(bp = NEXT_BLKP(bp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
 		//print the heap
 		if(verbose){
 
@@ -588,25 +3261,26 @@ void mm_checkheap(int verbose) {
 		
 		checkblock(bp);
 
-		if(GET_ALLOC(HDRP(bp)) == 0)
+		if(GET_ALLOC(HDRP(bp)) == 0){
 			fblock_counter++;
+		}else{
+			(*alloc_blocks)++;
+			if(is_slab(bp))
+				check_run((slab_run_t *)bp);
+		}
 	}
 
-	int fblock_list = check_free_list(bp);
-
-	if(fblock_counter != fblock_list){
-		printf("Error: free block number from check \
-			heap and check free list doesn't match\n");
-		printf("heap free block num: [%d]\n", fblock_counter);
-		printf("free list free block num: [%d]\n", fblock_list);
+	if(check_mode != MM_CHECK_FULL &&
+	 next_start(start, START_BIT(s->hi)) != START_BIT(s->hi)){
+		printf("Error: block start bitmap has a block past the last one \
+			of segment @ [%p]\n", s->lo);
 	}
-
-	if(verbose){
-		printf("Free block number counted in heap: %d\n", fblock_counter);
-		printf("Free block number counted in free list: %d\n", fblock_list);
-		printf("----------------------------------\n");
+	if(HDRP(bp) != epilogue_ptr){
+		printf("Error: blocks of segment @ [%p] end @ [%p], \
+			not at its epilogue\n", s->lo, HDRP(bp));
 	}
-	
+
+	return fblock_counter;
 }
 
 //check each block 
@@ -641,12 +3315,18 @@ static void checkblock(void *bp){
 
 	}
 
-	if(h_alloc)	//allocated block, no footer
+	if(h_alloc)	//allocated block, no footer unless the config keeps them
 	{
 		if((long)h_size != (long)(NEXT_BLKP(bp)) - (long)bp){
 			printf("Error: blokc @ [%p]: size [%d] of \
 				current block is invalid\n",bp, (int)h_size);
 		}
+		//slab runs fill their block with slots
+		if(FOOTERS && !is_slab(bp) &&
+		 GET(FTRP(bp)) != PACK(h_size, 0, 1)){
+			printf("Error: block @ [%p]: footer of \
+				allocated block doesn't match its header\n", bp);
+		}
 	}
 	//free block, has header and footer
 	else{
@@ -670,18 +3350,118 @@ static void checkblock(void *bp){
 	}
 }
 
-//check_free_list: check the free list
-static int check_free_list(void *bp){
+//check_tcache: check the calling thread's cache
+static void check_tcache(void){
+	for(size_t bin = 0; bin < TCACHE_BINS; bin++){
+		unsigned int ofs = tcache.head[bin];
+
+		for(int i = 0; i < tcache.count[bin]; i++){
+			char *bp = OFS_PTR(ofs);
+
+			if(ofs == 0 || !in_heap(bp) || !aligned(bp)){
+				printf("Error: tcache stack %d is broken @ [%p]\n",
+				 (int)bin, bp);
+				break;
+			}
+			if(!GET_ALLOC(HDRP(bp)) || TCACHE_BIN(GET_SIZE(HDRP(bp))) != bin){
+				printf("Error: block @ [%p] in tcache stack %d is free \
+					or has size [%d]\n", bp, (int)bin,
+					(int)GET_SIZE(HDRP(bp)));
+			}
+			if(find_arena(bp) != arena){
+				printf("Error: block @ [%p] in tcache stack %d belongs \
+					to another arena\n", bp, (int)bin);
+			}
+			ofs = GET(bp);
+		}
+	}
+}
+
+//check_quick: check the quick lists of arena a
+static void check_quick(arena_t *a){
+	unsigned long total = 0;
+
+	for(size_t bin = 0; bin < QUICK_BINS; bin++){
+		unsigned int ofs = a->quick[bin];
+		int n = 0;
+
+		for(; ofs != 0; ofs = GET(OFS_PTR(ofs)), n++){
+			char *bp = OFS_PTR(ofs);
+
+			if(!in_heap(bp) || !aligned(bp)){
+				printf("Error: quick list %d is broken @ [%p]\n",
+				 (int)bin, bp);
+				break;
+			}
+			if(!GET_ALLOC(HDRP(bp)) || QUICK_BIN(GET_SIZE(HDRP(bp))) != bin ||
+			 find_arena(bp) != a){
+				printf("Error: block @ [%p] on quick list %d is free, has \
+					size [%d] or belongs to another arena\n", bp, (int)bin,
+					(int)GET_SIZE(HDRP(bp)));
+			}
+		}
+		if(n != a->quick_count[bin]){
+			printf("Error: quick list %d holds %d blocks, counts %d\n",
+			 (int)bin, n, a->quick_count[bin]);
+		}
+		total += n;
+	}
+	if(total != a->quick_total){
+		printf("Error: quick lists hold %lu blocks, count %lu\n", total,
+		 a->quick_total);
+	}
+}
+
+//check_run: check a slab run met in the heap walk
+static void check_run(slab_run_t *run){
+	int used = 0;
+
+	if(PAGE_INDEX(run) * RUN_SIZE != (size_t)((char *)run - base_ptr) ||
+	 GET_SIZE(HDRP(run)) < RUN_SIZE){
+		printf("Error: slab run @ [%p] is not a page aligned block\n", run);
+	}
+	if(run->size != SLAB_SIZE(SLAB_CLASS(run->size)) || 
+	 SLAB_CLASS(run->size) >= SLAB_CLASSES ||
+	 run->slots != (RUN_SIZE - WSIZE - sizeof(slab_run_t)) / run->size){
+		printf("Error: slab run @ [%p] has object size [%d], %d slots\n",
+		 run, run->size, run->slots);
+		return;
+	}
+	for(size_t i = 0; i < 8 * sizeof(run->map); i++){
+		int bit = (run->map[i / 64] >> (i % 64)) & 1;
+
+		if(i < run->slots)
+			used += bit;
+		else if(!bit)
+			printf("Error: slab run @ [%p] has a clear bit past its slots\n",
+			 run);
+	}
+	if(used != run->used){
+		printf("Error: slab run @ [%p] counts %d used slots, its map %d\n",
+		 run, run->used, used);
+	}
+	if(run->used < run->slots && run->prev == 0 &&
+	 find_arena(run)->slab[SLAB_CLASS(run->size)] != TO_OFS(run)){
+		printf("Error: slab run @ [%p] with free slots isn't listed\n", run);
+	}
+}
+
+//check_free_list: check the free lists of arena a
+static int check_free_list(arena_t *a){
 
 	char *temp;
+	char *bp;
 	int fblock_counter = 0;
 	size_t index = 0;
-	size_t size = GET_SIZE(HDRP(bp));
 
-	for(temp = (char *)heap_list + DSIZE;
-	 temp != ((char *)heap_list + LIST_NUM * DSIZE) ;
+	for(temp = a->lists;
+	 temp != (a->lists + LIST_NUM * DSIZE) ;
 	  temp = (char *)temp + DSIZE){
+		int hinted = 0;
+
 		for(bp = NEXT_FREE_BLKP(temp); bp != temp; bp = NEXT_FREE_BLKP(bp)){
+			size_t size = GET_SIZE(HDRP(bp));
+
 			//check each free block
 			checkblock(bp);
 
@@ -694,25 +3474,78 @@ static int check_free_list(void *bp){
 			}
 
 		//check the block size is within the range of the current free list.
-			if(index < 10){
-				size_t max_size = 1 << (index + 4);
-				size_t min_size = (1 << (index + 3)) + 1;
-				
-				if(size > max_size || size < min_size){
-					printf("Error: size[%d] is invalid in the \
-						current free list[%d]\n", (int)size, (int)index);
-				}
-			}else{
-				//last list size should > 8192
-				if(size <= 8192){
-					printf("Error: size[%d] is invalid in the \
-						current free list[%d]\n", (int)size, (int)index);
-				}
+			if(get_list_index(size) != index){
+				printf("Error: size[%d] is invalid in the \
+					current free list[%d]\n", (int)size, (int)index);
+			}
+			//an address ordered list must be sorted
+			if((ao_classes & (1U << LIST_CLASS(index))) &&
+			 NEXT_FREE_BLKP(bp) != temp && NEXT_FREE_BLKP(bp) < bp){
+				printf("Error: free list[%d] is out of address order \
+					@ [%p]\n", (int)index, bp);
+			}
+			if(a->hint[index] == TO_OFS(bp)){
+				hinted = 1;
 			}
 			fblock_counter++;
 		}
+		//the hint is a block of the list or its head
+		if(a->hint[index] != 0 && !hinted &&
+		 a->hint[index] != TO_OFS(temp)){
+			printf("Error: hint of free list[%d] is not in the list\n",
+			 (int)index);
+		}
+#ifdef TLSF
+		//the list's bits must match whether it is empty
+		if(!(a->sl_bitmap[index / SL_COUNT] & (1U << (index % SL_COUNT))) !=
+		 (NEXT_FREE_BLKP(temp) == temp) ||
+		 !(a->fl_bitmap & (1U << (index / SL_COUNT))) !=
+		 (a->sl_bitmap[index / SL_COUNT] == 0)){
+			printf("Error: bitmaps are wrong for free list[%d]\n", (int)index);
+		}
+#endif
 		index++;
 	}
+#ifdef TREE_LIST
+	//the size tree holds the blocks of TREE_LIST
+	fblock_counter += check_tree(a->tree, NULL, NULL, ~0U);
+#endif
 	return fblock_counter;
 }
 
+#ifdef TREE_LIST
+/*
+ * check_tree: check the subtree at offset ofs, whose nodes must sort
+ * between lo and hi (NULL if unbounded) and have priorities below prio.
+ * Return the number of blocks in it.
+ */
+static int check_tree(unsigned int ofs, char *lo, char *hi, unsigned int prio){
+	char *bp = OFS_PTR(ofs);
+	size_t size;
+
+	if(ofs == 0){
+		return 0;
+	}
+	if(!in_heap(bp) || !aligned(bp)){
+		printf("Error: size tree node @ [%p] is out of the heap\n", bp);
+		return 0;
+	}
+	size = GET_SIZE(HDRP(bp));
+	checkblock(bp);
+	if(GET_ALLOC(HDRP(bp)) || size < TREE_MIN_SIZE){
+		printf("Error: size tree node @ [%p] is allocated or has \
+			size[%d]\n", bp, (int)size);
+	}
+	if((lo != NULL && !tree_less(lo, GET_SIZE(HDRP(lo)), bp)) ||
+	 (hi != NULL && !tree_less(bp, size, hi))){
+		printf("Error: size tree node @ [%p] is out of order\n", bp);
+	}
+	if(TREE_PRIO(ofs) >= prio){
+		printf("Error: size tree node @ [%p] has a higher priority \
+			than its parent\n", bp);
+	}
+	return 1 + check_tree(*LEFT_OFS(bp), lo, bp, TREE_PRIO(ofs)) +
+	 check_tree(*RIGHT_OFS(bp), bp, hi, TREE_PRIO(ofs));
+}
+#endif
+
@@ -23,3 +23,115 @@ extern int mm_init(void);
 /* This is largely for debugging.  You can do what you want with the
    verbose flag; we don't care. */
 extern void mm_checkheap(int verbose);
+
+/* Thread cache counters since the last mm_init */
+typedef struct {
+    unsigned long malloc_hits;   /* small mallocs served by a thread cache */
+    unsigned long malloc_misses; /* small mallocs that went to the seglists */
+    unsigned long free_hits;     /* small frees kept in a thread cache */
+    unsigned long flushed;       /* cached blocks spilled to the seglists */
+    unsigned long refilled;      /* blocks moved into a cache on a miss */
+} mm_tcache_stats_t;
+
+/* Max number of cached blocks per size class (0 turns the cache off),
+   and how many blocks a miss refills */
+extern void mm_set_tcache(int depth, int fill);
+extern void mm_tcache_stats(mm_tcache_stats_t *stats);
+
+/* Realloc counters since the last mm_init */
+typedef struct {
+    unsigned long shrunk;        /* reallocs that split the block in place */
+    unsigned long grown;         /* reallocs that absorbed the next block */
+    unsigned long extended;      /* ...of them after growing the heap top */
+    unsigned long moved;         /* reallocs that copied to a new block */
+    unsigned long bytes_copied;  /* payload bytes copied by the moves */
+    unsigned long remapped;      /* reallocs of mapped blocks via mremap */
+} mm_realloc_stats_t;
+
+extern void mm_realloc_stats(mm_realloc_stats_t *stats);
+
+/* Give free memory of the caller's arena back to the OS, keeping pad
+   free bytes at the heap top. Return 1 if any memory was released */
+extern int mm_trim(size_t pad);
+
+/* Give requests of size bytes or more their own mapping, instead of the
+   adaptive default. 0 maps nothing */
+extern void mm_set_mmap_threshold(size_t size);
+
+/* Grow the heap by steps that follow the recent growth rate and the heap
+   size, of at most cap bytes (1M by default). 0 grows by fixed chunks */
+extern void mm_set_growth(size_t cap);
+
+/* Keep the seglists of each class whose bit is set address ordered, the
+   rest LIFO. A class is a seglist, or a first level with -DTLSF. Takes
+   effect at the next mm_init */
+extern void mm_set_list_order(unsigned int classes);
+
+/* Serve requests of up to 16 bytes from slab runs (1) or the seglists */
+extern void mm_set_slab(int on);
+
+/* Leave small freed blocks unmerged on quick lists, merging a list once
+   it holds limit blocks and all of them before the heap grows. 0 (the
+   default) coalesces every free right away */
+extern void mm_set_deferred(int limit);
+
+/* What mm_checkheap checks, from the next mm_init on: the whole heap
+   (the default), the blocks changed since the last call, or the blocks
+   starting in a random window of window bytes (0: 4K). Changed blocks
+   past the log's 4096 entries get the whole heap checked */
+#define MM_CHECK_FULL        0
+#define MM_CHECK_INCREMENTAL 1
+#define MM_CHECK_SAMPLE      2
+
+extern void mm_set_check(int mode, size_t window);
+
+/* Free block size classes of mm_stats: <= 16, 32, ..., 8192, and more */
+#define MM_SIZE_CLASSES 11
+
+/* Heap layout. The block counters are kept as the heap changes, the
+   free blocks are counted by a walk of the free lists, so call mm_stats
+   while no other thread allocates */
+typedef struct {
+    size_t heap_bytes;           /* the mem_sbrk heap */
+    size_t mapped_bytes;         /* mapped blocks, headers included */
+    unsigned long free_blocks[MM_SIZE_CLASSES];
+    size_t free_bytes[MM_SIZE_CLASSES];
+    unsigned long total_free_blocks;
+    size_t total_free_bytes;
+    size_t largest_free;         /* the biggest free block */
+    double ext_frag;             /* 1 - largest_free / total_free_bytes */
+    unsigned long alloc_blocks;  /* heap blocks in use, slab runs and
+                                    thread cached blocks included */
+    unsigned long mapped_blocks;
+    size_t overhead_bytes;       /* headers of blocks in use, prologues,
+                                    epilogues and padding words */
+    unsigned long splits;        /* free blocks split since mm_init */
+    unsigned long coalesces;     /* free blocks merged since mm_init */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/* Sample about one allocation per rate bytes (0, the default, is off),
+   keeping its backtrace, size and lifetime outside the heap. Samples
+   are summed per site: the backtrace and the tag the allocating thread
+   set last (-1 if none). mm_init drops them */
+extern void mm_set_profile(size_t rate);
+extern void mm_profile_tag(long tag);
+
+/* Write the sites, most live bytes first, as flat text or as a pprof
+   heap profile. Return the number of sites */
+#define MM_PROF_TEXT         0
+#define MM_PROF_PPROF        1
+
+extern int mm_profile_dump(FILE *out, int format);
+
+/* A region for objects that are freed together: mm_arena_alloc bumps a
+   pointer through chunks taken from the heap, mm_arena_destroy frees them
+   all at once. Its objects are 8 byte aligned and can't be freed or
+   reallocated one by one. One thread uses a region at a time, and
+   mm_init drops them with the rest of the heap */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(void);
+extern void *mm_arena_alloc(mm_arena_t *a, size_t size);
+extern void mm_arena_destroy(mm_arena_t *a);
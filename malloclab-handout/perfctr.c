@@ -0,0 +1,121 @@
+/*
+ * perfctr.c - count hardware events around a timed run with
+ *     perf_event_open. Each event gets its own file descriptor, so a
+ *     machine that lacks one of them (or a VM without a PMU, where all
+ *     of them fail) still counts the rest. The kernel multiplexes them
+ *     if there are more events than counters.
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+
+#define CACHE_MISS(cache) (PERF_COUNT_HW_CACHE_##cache | \
+    PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} events[PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(L1D) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(DTLB) },
+};
+#endif
+
+const char *perf_event_names[PERF_EVENTS] = {
+    "instr", "L1Dmiss", "LLCmiss", "brmiss", "dTLBmiss"
+};
+
+static int fds[PERF_EVENTS];
+static int num_open = 0;
+
+/*
+ * perf_init - open every event for the calling thread, disabled
+ */
+int perf_init(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+        fds[i] = -1;
+    num_open = 0;
+#ifdef __linux__
+    for (i = 0; i < PERF_EVENTS; i++) {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] >= 0)
+            num_open++;
+    }
+#endif
+    return num_open;
+}
+
+int perf_available(void)
+{
+    return num_open;
+}
+
+void perf_start(void)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void perf_stop(perf_counts_t *counts)
+{
+    int i;
+
+    perf_clear(counts);
+#ifdef __linux__
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (i = 0; i < PERF_EVENTS; i++) {
+        unsigned long long v[3];    /* value, time enabled, time running */
+
+        if (fds[i] < 0 || read(fds[i], v, sizeof(v)) != sizeof(v) ||
+            v[2] == 0)
+            continue;
+        counts->count[i] = (double)v[0];
+        if (v[2] < v[1])
+            counts->count[i] *= (double)v[1] / v[2];
+    }
+#else
+    (void)i;
+#endif
+}
+
+void perf_clear(perf_counts_t *counts)
+{
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+        counts->count[i] = -1;
+}
@@ -0,0 +1,40 @@
+/*
+ * perfctr.h - hardware event counts of a timed run, from the Linux
+ *     perf_event_open interface
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* the events counted, indexes into perf_counts_t.count */
+#define PERF_INSTR          0   /* instructions retired */
+#define PERF_L1D_MISS       1   /* L1 data cache read misses */
+#define PERF_LLC_MISS       2   /* last level cache misses */
+#define PERF_BRANCH_MISS    3   /* mispredicted branches */
+#define PERF_DTLB_MISS      4   /* data TLB read misses */
+#define PERF_EVENTS         5
+
+typedef struct {
+    double count[PERF_EVENTS];  /* user space only, < 0 if the event
+                                   couldn't be opened or never ran */
+} perf_counts_t;
+
+/* short column names of the events */
+extern const char *perf_event_names[PERF_EVENTS];
+
+/* Open the events of the calling thread. Return the number that could
+   be opened, 0 if perf events are unavailable (no PMU, or forbidden by
+   perf_event_paranoid), and the timers run as they would without them */
+int perf_init(void);
+
+/* Number of events perf_init opened */
+int perf_available(void);
+
+/* Zero and start the counters, then stop them and read the counts.
+   Multiplexed events are scaled to the time they were enabled */
+void perf_start(void);
+void perf_stop(perf_counts_t *counts);
+
+/* Mark every count as unavailable */
+void perf_clear(perf_counts_t *counts);
+
+#endif /* __PERFCTR_H_ */
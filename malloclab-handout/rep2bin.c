@@ -0,0 +1,120 @@
+/*
+ * rep2bin - convert a .rep trace file to the binary trace format of
+ * tracefile.h, which mdriver maps and replays without parsing.
+ *
+ * usage: rep2bin [-d] <in.rep> <out>
+ *   -d  delta encode the sizes into 8 byte records (half the size of
+ *       the plain ones, mdriver decodes them when it loads the trace)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+
+#define MAXLINE 1024
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s [-d] <in.rep> <out>\n", prog);
+    exit(1);
+}
+
+static void app_error(const char *msg, const char *filename)
+{
+    fprintf(stderr, "%s: %s\n", filename, msg);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    btrace_hdr_t hdr;
+    btrace_op_t *ops;
+    char type[MAXLINE];
+    int num_ids, index, i, c;
+    int size = 0;
+    int delta = 0;
+
+    while ((c = getopt(argc, argv, "dh")) != EOF) {
+        switch (c) {
+        case 'd':
+            delta = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+
+    if ((in = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    /* the four header numbers of a .rep file */
+    memset(&hdr, 0, sizeof(hdr));
+    if (fscanf(in, "%d %d %d %d", &hdr.weight, &num_ids, &hdr.num_ops,
+               &hdr.ignore_ranges) != 4 || hdr.num_ops < 0)
+        app_error("bad trace header", argv[optind]);
+
+    if ((ops = calloc(hdr.num_ops, sizeof(*ops))) == NULL)
+        app_error("out of memory", argv[optind]);
+
+    /* like mdriver, a trace without ids still has num_ids 1 */
+    hdr.max_id = 0;
+    for (i = 0; i < hdr.num_ops; i++) {
+        if (fscanf(in, "%s", type) != 1)
+            app_error("fewer requests than the header says", argv[optind]);
+        switch (type[0]) {
+        case 'a':
+        case 'c':
+        case 'r':
+            /* a request without a size repeats the last one, which is
+               how mdriver reads it */
+            if (fscanf(in, "%d", &index) != 1 || index < 0 ||
+                index > BTRACE_INDEX)
+                app_error("bad alloc, calloc or realloc request", argv[optind]);
+            if (fscanf(in, "%d", &size) == 1 && size < 0)
+                app_error("negative request size", argv[optind]);
+            ops[i].type = type[0] == 'a' ? BTRACE_ALLOC :
+                type[0] == 'c' ? BTRACE_CALLOC : BTRACE_REALLOC;
+            ops[i].index = index;
+            ops[i].size = size;
+            if (index > hdr.max_id)
+                hdr.max_id = index;
+            break;
+        case 'b':
+        case 'e':
+            ops[i].type = type[0] == 'b' ? BTRACE_ARENA_BEGIN : BTRACE_ARENA_END;
+            break;
+        case 'f':
+            if (fscanf(in, "%d", &index) != 1 || index < -1 ||
+                index > BTRACE_INDEX)
+                app_error("bad free request", argv[optind]);
+            ops[i].type = BTRACE_FREE;
+            ops[i].index = index;
+            break;
+        default:
+            app_error("bogus request type", argv[optind]);
+        }
+    }
+    fclose(in);
+    if (hdr.max_id != num_ids - 1)
+        app_error("the header's id count doesn't match the ids used",
+                  argv[optind]);
+
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+        perror(argv[optind + 1]);
+        exit(1);
+    }
+    if (btrace_write(out, &hdr, ops, delta) < 0)
+        app_error("write failed", argv[optind + 1]);
+    if (fclose(out) != 0)
+        app_error("write failed", argv[optind + 1]);
+
+    free(ops);
+    return 0;
+}
@@ -0,0 +1,24 @@
+# arena.spec - request handlers that allocate into a region and drop it
+# at the end of each request, the workload of traces/arena.rep
+#
+#   ./gentrace specs/arena.spec traces/arena.rep
+#   ./mdriver -f traces/arena.rep        (regions with mm_arena_*)
+#   ./mdriver -N -f traces/arena.rep     (the same as mallocs and frees)
+#
+seed 1
+weight 1
+
+# start-up: configuration and caches that outlive every request
+phase 2000
+sizes 32-256:70 1024-8192:30
+lifetime uniform 20000 60000
+pattern random
+
+# requests: a few hundred small objects each, headers, strings and
+# parse nodes, most of them live to the end of the request; a few
+# zeroed buffers go on the heap and a share of them outlive it
+phase 90000
+sizes 8-64:60 65-512:30 1024-4096:9 16384-32768:1
+lifetime exp 400
+calloc 0.05
+pattern region 300
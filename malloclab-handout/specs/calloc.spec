@@ -0,0 +1,24 @@
+# calloc.spec - most allocations are callocs, the workload of traces/calloc.rep
+#
+#   ./gentrace specs/calloc.spec traces/calloc.rep
+#
+seed 1
+weight 1
+
+sizes 16-128:60 129-1024:30 2048-16384:8 65536-262144:1
+calloc 0.9
+pattern random
+
+# start-up: tables and arrays that stay, so the heap keeps growing
+# into memory it never used
+phase 5000
+lifetime uniform 5000 30000
+
+# steady state: zeroed scratch buffers that mostly reuse freed blocks
+phase 40000
+lifetime exp 300
+
+# a second burst of long lived, mostly large, zeroed structures
+phase 3000
+sizes 1024-8192:90 16384-65536:10
+lifetime uniform 2000 10000
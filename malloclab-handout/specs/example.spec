@@ -0,0 +1,33 @@
+# example.spec - a workload that changes character three times
+#
+#   ./gentrace specs/example.spec example.rep
+#   ./mdriver -g specs/example.spec,7
+#
+seed 1
+weight 1
+
+# defaults for every phase: mostly small objects, a few large buffers
+sizes 8-64:60 65-512:30 4096:5 16384-65536:1
+lifetime exp 200
+pattern random
+
+# start-up: objects that live a long time, a quarter of them grow
+phase 20000
+lifetime uniform 1000 50000
+realloc 0.25 1.5 6
+
+# steady state: a producer/consumer queue 2000 messages deep
+phase 100000
+sizes 64-256:80 1024-4096:20
+pattern fifo 2000
+realloc 0 1 0
+
+# request handling: short lived, stack ordered scratch blocks
+phase 100000
+sizes 16-128:70 512-2048:30
+pattern lifo 64
+
+# shutdown: random churn with a long tail of lifetimes
+phase 30000
+pattern random
+lifetime hist 1-10:50 11-1000:40 1001-20000:10
@@ -0,0 +1,82 @@
+/*
+ * tracefile.c - writers for the trace formats, shared by the tools that
+ * make traces (rep2bin, gentrace and mdriver -g)
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "tracefile.h"
+
+/*
+ * btrace_write - write a binary trace of hdr->num_ops requests, delta
+ *     encoded if delta is set. The magic, version and flags of hdr are
+ *     filled in. Return 0, or -1 if a write failed.
+ */
+int btrace_write(FILE *out, btrace_hdr_t *hdr, const btrace_op_t *ops,
+                 int delta)
+{
+    int64_t prev = 0;
+    int i;
+
+    memcpy(hdr->magic, BTRACE_MAGIC, sizeof(hdr->magic));
+    hdr->version = BTRACE_VERSION;
+    hdr->flags = delta ? BTRACE_DELTA : 0;
+    if (fwrite(hdr, sizeof(*hdr), 1, out) != 1)
+        return -1;
+
+    if (!delta) {
+        if (fwrite(ops, sizeof(*ops), hdr->num_ops, out) !=
+            (size_t)hdr->num_ops)
+            return -1;
+        return 0;
+    }
+    for (i = 0; i < hdr->num_ops; i++) {
+        btrace_dop_t d;
+
+        if (ops[i].type == BTRACE_ARENA_BEGIN)
+            d.op = BTRACE_DOP(BTRACE_FREE, BTRACE_DOP_BEGIN_ID);
+        else if (ops[i].type == BTRACE_ARENA_END)
+            d.op = BTRACE_DOP(BTRACE_FREE, BTRACE_DOP_END_ID);
+        else
+            d.op = BTRACE_DOP(ops[i].type, ops[i].index);
+        d.dsize = 0;
+        if (BTRACE_SIZED(ops[i].type)) {
+            /* sizes are in [0, 2^31), their difference fits */
+            d.dsize = (int32_t)((int64_t)ops[i].size - prev);
+            prev = ops[i].size;
+        }
+        if (fwrite(&d, sizeof(d), 1, out) != 1)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * rep_write - write the requests as a .rep text trace. Return 0, or -1
+ *     if a write failed.
+ */
+int rep_write(FILE *out, const btrace_hdr_t *hdr, const btrace_op_t *ops)
+{
+    int i;
+
+    if (fprintf(out, "%d\n%d\n%d\n%d\n", hdr->weight, hdr->max_id + 1,
+                hdr->num_ops, hdr->ignore_ranges) < 0)
+        return -1;
+    for (i = 0; i < hdr->num_ops; i++) {
+        int n;
+
+        if (ops[i].type == BTRACE_FREE)
+            n = fprintf(out, "f %d\n", ops[i].index);
+        else if (!BTRACE_SIZED(ops[i].type))
+            n = fprintf(out, "%c\n",
+                        ops[i].type == BTRACE_ARENA_BEGIN ? 'b' : 'e');
+        else
+            n = fprintf(out, "%c %d %llu\n",
+                        ops[i].type == BTRACE_ALLOC ? 'a' :
+                        ops[i].type == BTRACE_CALLOC ? 'c' : 'r',
+                        ops[i].index, (unsigned long long)ops[i].size);
+        if (n < 0)
+            return -1;
+    }
+    return 0;
+}
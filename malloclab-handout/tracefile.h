@@ -0,0 +1,71 @@
+/*
+ * tracefile.h - the binary trace format
+ *
+ * A binary trace is a header followed by num_ops fixed width records,
+ * in the byte order of the machine that wrote it. rep2bin writes them
+ * from .rep files, mdriver maps them and replays the records in place.
+ * With BTRACE_DELTA set the records are the smaller btrace_dop_t, which
+ * mdriver has to decode first.
+ */
+#ifndef __TRACEFILE_H_
+#define __TRACEFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define BTRACE_MAGIC	"MMTRACE"	/* 8 bytes with the NUL */
+#define BTRACE_VERSION	1
+#define BTRACE_DELTA	0x1			/* flag: delta encoded records */
+
+/* request types, the same values as mdriver's traceop_t */
+#define BTRACE_ALLOC	0
+#define BTRACE_FREE		1
+#define BTRACE_REALLOC	2
+#define BTRACE_CALLOC	3			/* calloc(1, size) */
+/* the allocs between these two go to a region, which frees them all at
+   its end; their frees are no-ops and they can't be realloc'd */
+#define BTRACE_ARENA_BEGIN	4
+#define BTRACE_ARENA_END	5
+/* whether a request of type t has a size */
+#define BTRACE_SIZED(t)	((t) != BTRACE_FREE && (t) < BTRACE_ARENA_BEGIN)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int32_t weight;
+    int32_t ignore_ranges;
+    int32_t num_ops;
+    int32_t max_id;         /* largest alloc/realloc/calloc id, 0 if none */
+} btrace_hdr_t;
+
+/* one request, laid out like mdriver's traceop_t */
+typedef struct {
+    int32_t type;
+    int32_t index;          /* -1 for free(NULL) */
+    uint64_t size;          /* 0 for free */
+} btrace_op_t;
+
+/* one request of a BTRACE_DELTA trace */
+typedef struct {
+    uint32_t op;            /* type << 30 | (index & BTRACE_INDEX) */
+    int32_t dsize;          /* size minus the size of the previous
+                               alloc, realloc or calloc, 0 for free */
+} btrace_dop_t;
+
+#define BTRACE_INDEX	0x3fffffff
+#define BTRACE_DOP(type, index)	((uint32_t)(type) << 30 | ((index) & BTRACE_INDEX))
+#define BTRACE_DOP_TYPE(op)		((op) >> 30)
+/* sign extends the 30 bit index, so that free(NULL) stays -1 */
+#define BTRACE_DOP_INDEX(op)	((int32_t)((op) << 2) >> 2)
+/* the two type bits have no room for the region requests, a delta
+   record stores them as frees of these ids */
+#define BTRACE_DOP_BEGIN_ID	(-2)
+#define BTRACE_DOP_END_ID	(-3)
+
+/* writers in tracefile.c, 0 on success and -1 if a write failed */
+int btrace_write(FILE *out, btrace_hdr_t *hdr, const btrace_op_t *ops,
+                 int delta);
+int rep_write(FILE *out, const btrace_hdr_t *hdr, const btrace_op_t *ops);
+
+#endif /* __TRACEFILE_H_ */